@@ -0,0 +1,310 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+/**
+\file benchmark_detector.cc Main file for the benchmark_detector executable.
+
+\section wpUsage Usage
+
+<code> benchmark_detector [--VAR VAL] [--exec FILE] IMAGE1 [IMAGE2 ...]</code>
+
+\section Description
+
+This program loads a learned FAST-ER tree and times the different implementations
+of the compiled detector on the images given on the commandline. The results of
+every implementation are checked against the bytecode interpreter, and any differences
+are reported.
+
+Detection in a mask is timed with a checkerboard mask of squares \c mask.block pixels
+across, which covers half of the image. The corners found in the mask are checked
+against the corners found in the whole image which lie in the mask.
+
+If \c profile.bytecode or \c profile.tree is set, then the number of times each node
+of the bytecode or of the tree is visited, and how often each orientation rejects a
+pixel, are counted over all of the images, and written to that file. See
+detector_profile::write() for the format.
+
+The program accpets standard GVars3 commandline arguments, and the default
+parameters are contained in \p benchmark_detector.cfg :
+
+\include benchmark_detector.cfg
+
+*/
+
+#include <gvars3/instances.h>
+#include <cvd/image_io.h>
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include "offsets.h"
+#include "faster_tree.h"
+#include "faster_circuit.h"
+#include "faster_compact.h"
+#include "thread_pool.h"
+#include "tree_file.h"
+
+using namespace std;
+using namespace CVD;
+using namespace GVars3;
+
+///Time a function.
+///@param f Function to time
+///@param repeats Number of times to run the function
+///@return Mean time per run in milliseconds
+double time_ms(const function<void()>& f, int repeats)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for(int i=0; i < repeats; i++)
+		f();
+
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / repeats;
+}
+
+///Print a timing result.
+///@param name Name of the implementation
+///@param ms Time taken in milliseconds
+///@param matches Whether the implementation produced the same results as the reference.
+void report(const string& name, double ms, bool matches)
+{
+	cout << name << " " << ms << " ms" << (matches?"":" MISMATCH") << endl;
+}
+
+///Driving program
+///@param argc Number of commandline arguments
+///@param argv List of commandline arguments. Contains GVars3 arguments, and images to process.
+int main(int argc, char** argv)
+{
+	GUI.LoadFile("benchmark_detector.cfg");
+	int lastarg = GUI.parseArguments(argc, argv);
+
+	create_offsets();
+
+	int threshold = GV3::get<int>("threshold", 35);
+	int repeats = GV3::get<int>("repeats", 10);
+	int max_threads = GV3::get<int>("max_threads", 0);
+	int mask_block = GV3::get<int>("mask.block", 64);
+	if(max_threads <= 0)
+		max_threads = max(1u, thread::hardware_concurrency());
+	string fname=GV3::get<string>("detector", "best_faster.tree");
+	string bytecode_profile_file = GV3::get<string>("profile.bytecode", "");
+	string tree_profile_file = GV3::get<string>("profile.tree", "");
+
+	//Load a detector from a tree file
+	flat_tree file_tree;
+	ifstream i;
+	i.open(fname.c_str());
+
+	if(!i.good())
+	{
+		cerr << "Error: " << fname << ": " << strerror(errno) << endl;
+		exit(1);
+	}
+	
+	try{
+		file_tree = load_tree_file(fname);
+	}
+	catch(ParseError p)
+	{
+		cerr << "Parse error in " << fname << endl;
+		exit(1);
+	}
+	const tree_element* tree = file_tree.tree();
+
+	//Profiles are accumulated over all of the images
+	detector_profile bytecode_profile, tree_profile_counts;
+
+	for(int a=lastarg; a < argc; a++)
+	{
+		Image<CVD::byte> im;
+		try{
+			im = img_load(argv[a]);
+		}
+		catch(const Exceptions::All& e)
+		{
+			cerr << "Failed to load " << argv[a] << ": " << e.what() << endl;
+			continue;
+		}
+
+		cout << argv[a] << " " << im.size() << endl;
+
+		ImageRef tl, br;
+		tie(tl,br) = tree->bbox();
+		int ymin = 1 - tl.y, ymax = im.size().y - 1 - br.y;
+		int xmin = 1 - tl.x, xmax = im.size().x - 1 - br.x;
+		
+		block_bytecode bytecode = tree->make_fast_detector();
+		bytecode.set_stride(im.row_stride());
+		block_bytecode jit = bytecode;
+		jit.compile();
+
+		block_bytecode minimised = bytecode;
+		minimised.minimise();
+		block_bytecode minimised_jit = minimised;
+		minimised_jit.compile();
+		cout << "bytecode " << bytecode.d.size() << " blocks, minimised " << minimised.d.size() << " blocks" << endl;
+
+		//Detection
+		vector<int> corners, c;
+		double t = time_ms([&](){ corners.clear(); bytecode.detect(im, corners, threshold, xmin, xmax, ymin, ymax);}, repeats);
+		report("detect.bytecode", t, true);
+
+		if(jit.jit)
+		{
+			t = time_ms([&](){ c.clear(); jit.detect(im, c, threshold, xmin, xmax, ymin, ymax);}, repeats);
+			report("detect.jit", t, c == corners);
+
+			vector<int> storage(corners.size());
+			corner_buffer buffer(storage.data(), storage.size());
+			t = time_ms([&](){ buffer.clear(); jit.detect(im, buffer, threshold, xmin, xmax, ymin, ymax);}, repeats);
+			report("detect.jit.buffer", t, vector<int>(storage.begin(), storage.begin() + buffer.size) == corners);
+		}
+		
+		t = time_ms([&](){ c.clear(); minimised.detect(im, c, threshold, xmin, xmax, ymin, ymax);}, repeats);
+		report("detect.bytecode.minimised", t, c == corners);
+
+		if(minimised_jit.jit)
+		{
+			t = time_ms([&](){ c.clear(); minimised_jit.detect(im, c, threshold, xmin, xmax, ymin, ymax);}, repeats);
+			report("detect.jit.minimised", t, c == corners);
+		}
+
+		if(compact_bytecode::fits(bytecode, im.size().x))
+		{
+			compact_bytecode compact(bytecode, im.size().x);
+			t = time_ms([&](){ c.clear(); compact.detect(im, c, threshold, xmin, xmax, ymin, ymax);}, repeats);
+			report("detect.compact", t, c == corners);
+
+			vector<unsigned int> visits;
+			bytecode.profile(im, threshold, xmin, xmax, ymin, ymax, visits);
+			compact_bytecode profiled(bytecode, im.size().x, visits);
+			t = time_ms([&](){ c.clear(); profiled.detect(im, c, threshold, xmin, xmax, ymin, ymax);}, repeats);
+			report("detect.compact.profiled", t, c == corners);
+		}
+
+		bitslice_circuit circuit(*tree);
+		t = time_ms([&](){ c.clear(); circuit.detect(im, c, threshold, xmin, xmax, ymin, ymax);}, repeats);
+		report("detect.circuit", t, c == corners);
+		cout << "circuit " << circuit.num_gates() << " gates " << circuit.num_offsets() << " offsets " << circuit.num_slots() << " slots" << endl;
+		
+		cout << "corners " << corners.size() << endl;
+
+		//Detection in a checkerboard mask
+		Image<CVD::byte> mask_image(im.size());
+		for(int y=0; y < im.size().y; y++)
+			for(int x=0; x < im.size().x; x++)
+				mask_image[y][x] = (x/mask_block + y/mask_block) % 2 == 0;
+		run_mask mask(mask_image);
+
+		vector<int> in_mask;
+		for(unsigned int i=0; i < corners.size(); i++)
+			if(mask_image.data()[corners[i]])
+				in_mask.push_back(corners[i]);
+
+		t = time_ms([&](){ c.clear(); bytecode.detect(im, c, threshold, mask, xmin, xmax, ymin, ymax);}, repeats);
+		report("detect.bytecode.masked", t, c == in_mask);
+		cout << "corners.masked " << in_mask.size() << endl;
+
+		//Detection with nonmaximal suppression
+		vector<ImageRef> nonmax, nm;
+		Image<int> scratch(im.size(), 0);
+		t = time_ms([&](){ nonmax = tree_detect_corners(im, tree, threshold, scratch);}, repeats);
+		report("nonmax.image", t, true);
+
+		vector<int> nonmax_scores;
+		t = time_ms([&](){ tree_detect_corners_stream(im, tree, threshold, nm, nonmax_scores);}, repeats);
+		report("nonmax.stream", t, nm == nonmax);
+
+		t = time_ms([&](){ tree_detect_corners_tiled(im, tree, threshold, nm, nonmax_scores);}, repeats);
+		report("nonmax.tiled", t, nm == nonmax);
+
+		//A corner at the edge of the mask is not suppressed by stronger corners outside it,
+		//so the corners are only compared where all of their neighbours are in the mask.
+		auto mask_interior = [&](const vector<ImageRef>& v)
+		{
+			vector<ImageRef> r;
+			for(unsigned int i=0; i < v.size(); i++)
+			{
+				bool inside = true;
+				for(int y=-1; y <= 1; y++)
+					for(int x=-1; x <= 1; x++)
+						inside = inside && mask_image[v[i] + ImageRef(x, y)];
+
+				if(inside)
+					r.push_back(v[i]);
+			}
+			return r;
+		};
+
+		t = time_ms([&](){ tree_detect_corners_masked(im, tree, threshold, mask, nm, nonmax_scores);}, repeats);
+		bool masked_matches = mask_interior(nm) == mask_interior(nonmax);
+		for(unsigned int i=0; i < nm.size(); i++)
+			masked_matches = masked_matches && mask_image[nm[i]];
+		report("nonmax.masked", t, masked_matches);
+		
+		//The row-parallel detector, on 1, 2, 4, ... threads. Any speedup depends on the 
+		//number of cores, but the corners must be the same for every number of threads.
+		const block_bytecode& fastest = jit.jit ? jit : bytecode;
+		for(int n=1; ; n = min(n*2, max_threads))
+		{
+			thread_pool pool(n);
+			t = time_ms([&](){ c.clear(); ordered_for(pool, ymin, ymax, 16, c, [&](int y0, int y1, vector<int>& r){ fastest.detect(im, r, threshold, xmin, xmax, y0, y1);});}, repeats);
+			report("detect.threads." + to_string(n), t, c == corners);
+
+			if(n == max_threads)
+				break;
+		}
+
+		//Scoring
+		vector<int> scores, s;
+		t = time_ms([&](){ bytecode.score(im.data(), im.size().x, corners, threshold, scores);}, repeats);
+		report("score.iterate.bytecode", t, true);
+
+		if(jit.jit)
+		{
+			t = time_ms([&](){ jit.score(im.data(), im.size().x, corners, threshold, s);}, repeats);
+			report("score.iterate.jit", t, s == scores);
+		}
+
+		//Profiling
+		if(bytecode_profile_file != "")
+			bytecode.profile(im, threshold, xmin, xmax, ymin, ymax, bytecode_profile);
+
+		if(tree_profile_file != "")
+			tree_profile(tree, im, threshold, xmin, xmax, ymin, ymax, tree_profile_counts);
+
+		cout << endl;
+	}
+
+	if(bytecode_profile_file != "")
+	{
+		ofstream o(bytecode_profile_file.c_str());
+		bytecode_profile.write(o, "bytecode");
+	}
+
+	if(tree_profile_file != "")
+	{
+		ofstream o(tree_profile_file.c_str());
+		tree_profile_counts.write(o, "tree");
+	}
+
+}
@@ -0,0 +1,116 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+/**
+\file convert_tree.cc Main file for the convert_tree executable.
+
+\section wpUsage Usage
+
+<code> convert_tree [--VAR VAL] [--exec FILE] INPUT OUTPUT</code>
+
+\section Description
+
+This program converts a learned FAST-ER tree between the text format made by
+tree_element::print() and the binary format (see \ref gTreeFile). The input may
+be in either format. The output format is given by the \c format variable, which is
+either \c binary or \c text. Trees in the binary format can be loaded by all of
+the programs which load trees, and are loaded much faster than text trees.
+
+The binary format records the offsets the tree was learned with, so the radii must
+be the same as the ones used in training.
+
+The program accpets standard GVars3 commandline arguments, and the default
+parameters are contained in \p convert_tree.cfg :
+
+\include convert_tree.cfg
+
+*/
+
+#include <gvars3/instances.h>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include "offsets.h"
+#include "faster_tree.h"
+#include "flat_tree.h"
+#include "tree_file.h"
+
+using namespace std;
+using namespace GVars3;
+
+///Driving program
+///@param argc Number of commandline arguments
+///@param argv List of commandline arguments. Contains GVars3 arguments, and the input and output files.
+int main(int argc, char** argv)
+{
+	GUI.LoadFile("convert_tree.cfg");
+	int lastarg = GUI.parseArguments(argc, argv);
+
+	if(argc - lastarg != 2)
+	{
+		cerr << "Usage: " << argv[0] << " [--VAR VAL] INPUT OUTPUT" << endl;
+		exit(1);
+	}
+
+	create_offsets();
+
+	string format = GV3::get<string>("format", "binary");
+	if(format != "binary" && format != "text")
+	{
+		cerr << "Error: format must be binary or text, not " << format << endl;
+		exit(1);
+	}
+
+	//Load the tree, in either format
+	string in_name = argv[lastarg];
+	ifstream in(in_name.c_str(), ios::binary);
+
+	if(!in.good())
+	{
+		cerr << "Error: " << in_name << ": " << strerror(errno) << endl;
+		exit(1);
+	}
+
+	flat_tree tree;
+	try{
+		tree = load_tree_file(in_name);
+	}
+	catch(ParseError p)
+	{
+		cerr << "Parse error in " << in_name << endl;
+		exit(1);
+	}
+
+	//Save it
+	string out_name = argv[lastarg+1];
+	ofstream out(out_name.c_str(), ios::binary);
+
+	if(format == "binary")
+		save_binary_tree(out, tree);
+	else
+		tree.print(out);
+
+	out.close();
+	if(!out.good())
+	{
+		cerr << "Error: " << out_name << ": " << strerror(errno) << endl;
+		exit(1);
+	}
+}
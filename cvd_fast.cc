@@ -55,3 +55,40 @@ void fast_12::operator()(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageR
 	fast_corner_score_12(i, cs, n, sc);
 	nonmax_suppression(cs, sc, c);
 }
+
+//The segment test detectors are monotonic in the threshold, and the scores are the
+//highest threshold at which each corner is detected. Non-maximal suppression only
+//depends on the scores, so a corner survives at a threshold exactly when it survives at 
+//threshold 0 and its score is at least the threshold.
+static void append_scored(const vector<pair<ImageRef, int> >& nonmax, vector<ImageRef>& c, vector<int>& s)
+{
+	for(unsigned int j=0; j < nonmax.size(); j++)
+	{
+		c.push_back(nonmax[j].first);
+		s.push_back(nonmax[j].second);
+	}
+}
+
+bool fast_9::detect_scored(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, std::vector<int>& s) const
+{
+	vector<ImageRef> cs;
+	vector<int> sc;
+	vector<pair<ImageRef, int> > nonmax;
+	fast_corner_detect_9(i, cs, 0);
+	fast_corner_score_9(i, cs, 0, sc);
+	nonmax_suppression_with_scores(cs, sc, nonmax);
+	append_scored(nonmax, c, s);
+	return true;
+}
+
+bool fast_12::detect_scored(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, std::vector<int>& s) const
+{
+	vector<ImageRef> cs;
+	vector<int> sc;
+	vector<pair<ImageRef, int> > nonmax;
+	fast_corner_detect_12(i, cs, 0);
+	fast_corner_score_12(i, cs, 0, sc);
+	nonmax_suppression_with_scores(cs, sc, nonmax);
+	append_scored(nonmax, c, s);
+	return true;
+}
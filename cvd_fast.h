@@ -30,6 +30,7 @@
 struct fast_9: public DetectT
 {
         virtual void operator()(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, unsigned int N) const;
+        virtual bool detect_scored(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, std::vector<int>& s) const;
 };
 
 struct fast_9_old: public DetectT
@@ -40,6 +41,7 @@ struct fast_9_old: public DetectT
 struct fast_12: public DetectT
 {
         virtual void operator()(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, unsigned int N) const;
+        virtual bool detect_scored(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, std::vector<int>& s) const;
 };
 
 #endif
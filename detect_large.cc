@@ -0,0 +1,126 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+/**
+\file detect_large.cc Main file for the detect_large executable.
+
+\section wpUsage Usage
+
+<code> detect_large [--VAR VAL] [--exec FILE] IMAGE1 [IMAGE2 ...]</code>
+
+\section Description
+
+This program loads a learned FAST-ER tree and detects corners in images which may
+be too large to fit in memory. The images must be binary 8 bit PGMs. They are read
+a band of rows at a time (see tree_detect_corners_large()), so the memory used does
+not depend on the height of the image. An image name of <code>-</code> reads the
+image from the standard input.
+
+The corners are written to the standard output as they are found, one per line, as
+<code>x y score</code>.
+
+The program accpets standard GVars3 commandline arguments, and the default
+parameters are contained in \p detect_large.cfg :
+
+\include detect_large.cfg
+
+*/
+
+#include <gvars3/instances.h>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include "offsets.h"
+#include "faster_tree.h"
+#include "large_image.h"
+#include "tree_file.h"
+
+using namespace std;
+using namespace GVars3;
+
+///Driving program
+///@param argc Number of commandline arguments
+///@param argv List of commandline arguments. Contains GVars3 arguments, and images to process.
+int main(int argc, char** argv)
+{
+	GUI.LoadFile("detect_large.cfg");
+	int lastarg = GUI.parseArguments(argc, argv);
+
+	create_offsets();
+
+	int threshold = GV3::get<int>("threshold", 35);
+	int band = GV3::get<int>("band", 256);
+	string fname=GV3::get<string>("detector", "best_faster.tree");
+
+	//Load a detector from a tree file
+	flat_tree tree;
+	ifstream i;
+	i.open(fname.c_str());
+
+	if(!i.good())
+	{
+		cerr << "Error: " << fname << ": " << strerror(errno) << endl;
+		exit(1);
+	}
+	
+	try{
+		tree = load_tree_file(fname);
+	}
+	catch(ParseError p)
+	{
+		cerr << "Parse error in " << fname << endl;
+		exit(1);
+	}
+	const tree_element* detector = tree.tree();
+
+	for(int a=lastarg; a < argc; a++)
+	{
+		ifstream f;
+		istream* in = &cin;
+
+		if(strcmp(argv[a], "-") != 0)
+		{
+			f.open(argv[a], ios::binary);
+			if(!f.good())
+			{
+				cerr << "Error: " << argv[a] << ": " << strerror(errno) << endl;
+				continue;
+			}
+			in = &f;
+		}
+
+		try{
+			pgm_reader image(*in);
+			cerr << argv[a] << " " << image.width() << "x" << image.height() << endl;
+
+			tree_detect_corners_large(image, detector, threshold, band, [](int64_t x, int64_t y, int score)
+			{
+				cout << x << " " << y << " " << score << "\n";
+			});
+		}
+		catch(ParseError p)
+		{
+			cerr << "Error: " << argv[a] << " is not an 8 bit binary PGM" << endl;
+		}
+
+		cout << flush;
+	}
+
+}
@@ -0,0 +1,165 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "detector_cache.h"
+#include "faster_tree.h"
+
+#include <cvd/byte.h>
+#include <tuple>
+
+///\cond never
+using namespace std;
+using namespace CVD;
+///\endcond
+
+bool detector_cache::key::operator<(const key& k) const
+{
+	return tie(tree, nodes, stride, pixel, jit, form) < tie(k.tree, k.nodes, k.stride, k.pixel, k.jit, k.form);
+}
+
+///Get a compiled detector, compiling it if it is not already in the cache.
+///@param k The key identifying the detector
+///@param compile Function which compiles the detector.
+///@return The compiled detector.
+shared_ptr<const void> detector_cache::get(const key& k, const function<shared_ptr<const void>()>& compile)
+{
+	{
+		lock_guard<mutex> l(lock);
+		map<key, lru_list::iterator>::iterator i = index.find(k);
+
+		if(i != index.end())
+		{
+			//Move to the front of the list
+			detectors.splice(detectors.begin(), detectors, i->second);
+			return i->second->second;
+		}
+	}
+
+	//Compile outside of the lock, since it is relatively slow.
+	shared_ptr<const void> b = compile();
+
+	lock_guard<mutex> l(lock);
+	
+	//Another thread may have compiled the same detector in the meantime.
+	map<key, lru_list::iterator>::iterator i = index.find(k);
+	if(i != index.end())
+		return i->second->second;
+
+	detectors.push_front(make_pair(k, b));
+	index[k] = detectors.begin();
+
+	while(detectors.size() > max_size)
+	{
+		index.erase(detectors.back().first);
+		detectors.pop_back();
+	}
+
+	return b;
+}
+
+///Get a detector compiled to bytecode, compiling it if it is not already in the cache.
+///The bytecode is minimised (see block_bytecode::minimise()) before it is compiled to machine code.
+///The interpreter uses offsets computed for one row stride (see block_bytecode::set_stride()),
+///so a detector is cached for each row stride.
+///@param tree The tree to compile
+///@param stride Row stride of the images the detector will be used on.
+///@param jit Whether to compile the detector to machine code.
+///@return The compiled detector.
+shared_ptr<const block_bytecode> detector_cache::get(const tree_element& tree, int stride, bool jit)
+{
+	key k = {tree.hash(), tree.num_nodes(), stride, type_index(typeid(CVD::byte)), jit, type_index(typeid(block_bytecode))};
+
+	return static_pointer_cast<const block_bytecode>(get(k, [&]()
+	{
+		shared_ptr<block_bytecode> b(new block_bytecode(tree.make_fast_detector()));
+		b->minimise();
+		b->set_stride(stride);
+		if(jit)
+			b->compile();
+		return shared_ptr<const void>(b);
+	}));
+}
+
+///Get a detector compiled to a bitslice_circuit, compiling it if it is not already in the 
+///cache. The circuit does not depend on the row stride.
+///@param tree The tree to compile
+///@return The compiled detector.
+shared_ptr<const bitslice_circuit> detector_cache::get_circuit(const tree_element& tree)
+{
+	key k = {tree.hash(), tree.num_nodes(), 0, type_index(typeid(CVD::byte)), false, type_index(typeid(bitslice_circuit))};
+
+	return static_pointer_cast<const bitslice_circuit>(get(k, [&]()
+	{
+		return shared_ptr<const void>(new bitslice_circuit(tree));
+	}));
+}
+
+///Get a detector compiled to compact_bytecode, compiling it if it is not already in the cache.
+///@param tree The tree to compile
+///@param stride Row stride of the images the detector will be used on.
+///@return The compiled detector, or null if the detector is too large for compact_bytecode.
+shared_ptr<const compact_bytecode> detector_cache::get_compact(const tree_element& tree, int stride)
+{
+	key k = {tree.hash(), tree.num_nodes(), stride, type_index(typeid(CVD::byte)), false, type_index(typeid(compact_bytecode))};
+
+	return static_pointer_cast<const compact_bytecode>(get(k, [&]()
+	{
+		block_bytecode b = tree.make_fast_detector();
+		b.minimise();
+
+		if(compact_bytecode::fits(b, stride))
+			return shared_ptr<const void>(new compact_bytecode(b, stride));
+		else
+			return shared_ptr<const void>();
+	}));
+}
+
+///Remove all compiled versions of a given tree from the cache. Detectors
+///which are currently in use remain valid until they are released.
+///@param tree The tree to remove.
+void detector_cache::invalidate(const tree_element& tree)
+{
+	uint64_t h = tree.hash();
+
+	lock_guard<mutex> l(lock);
+
+	for(lru_list::iterator i=detectors.begin(); i != detectors.end(); )
+		if(i->first.tree == h)
+		{
+			index.erase(i->first);
+			i = detectors.erase(i);
+		}
+		else
+			++i;
+}
+
+///Remove all detectors from the cache. Detectors which are currently in use remain 
+///valid until they are released.
+void detector_cache::clear()
+{
+	lock_guard<mutex> l(lock);
+	index.clear();
+	detectors.clear();
+}
+
+detector_cache& detector_cache::instance()
+{
+	static detector_cache cache;
+	return cache;
+}
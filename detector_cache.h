@@ -0,0 +1,93 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_DETECTOR_CACHE_H
+#define INC_DETECTOR_CACHE_H
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <typeindex>
+#include <functional>
+#include <stdint.h>
+
+#include "faster_bytecode.h"
+#include "faster_circuit.h"
+#include "faster_compact.h"
+
+class tree_element;
+
+///This class caches compiled detectors, so that the work of compiling a tree to bytecode
+///and machine code, or to another form, is done once, rather than on every image. Compiled detectors are
+///identified by the structure of the tree, the row stride they were compiled for (for
+///the forms which depend on it) and the pixel type. The cache is safe to use from multiple threads, and the detectors
+///it returns may be used concurrently.
+///
+///The cache holds a limited number of detectors, and discards the least recently used
+///one when it is full. Compiled detectors depend on ::offsets, so the cache must be 
+///cleared if ::offsets is regenerated.
+///@ingroup gFastTree
+class detector_cache
+{
+	public:
+		///@param capacity Maximum number of compiled detectors to hold.
+		detector_cache(unsigned int capacity=16)
+		:max_size(capacity)
+		{}
+
+		std::shared_ptr<const block_bytecode> get(const tree_element& tree, int stride, bool jit);
+		std::shared_ptr<const bitslice_circuit> get_circuit(const tree_element& tree);
+		std::shared_ptr<const compact_bytecode> get_compact(const tree_element& tree, int stride);
+
+		void invalidate(const tree_element& tree);
+		void clear();
+		
+		///The cache used by the detection functions.
+		static detector_cache& instance();
+
+	private:
+		///Everything which identifies a compiled detector.
+		struct key
+		{
+			uint64_t        tree;   ///< Structural hash of the tree. See tree_element::hash()
+			int             nodes;  ///< Number of nodes in the tree, to guard against hash collisions
+			int             stride; ///< Row stride that the detector was compiled for, or 0 if it does not depend on the stride
+			std::type_index pixel;  ///< Pixel type that the detector operates on
+			bool            jit;    ///< Whether the detector has been compiled to machine code
+			std::type_index form;   ///< Type of the compiled detector
+
+			///Lexicographic ordering for std::map
+			///@param k key to compare with
+			bool operator<(const key& k) const;
+		};
+
+		///Cached detectors, in order of use (most recent first). The type of each
+		///detector is given by key::form.
+		typedef std::list<std::pair<key, std::shared_ptr<const void> > > lru_list;
+
+		std::shared_ptr<const void> get(const key& k, const std::function<std::shared_ptr<const void>()>& compile);
+
+		std::mutex lock;                                ///< Protects the data below
+		unsigned int max_size;                          ///< Maximum number of detectors to hold
+		lru_list detectors;                             ///< The cached detectors
+		std::map<key, lru_list::iterator> index;        ///< Index in to ::detectors
+};
+
+#endif
@@ -26,36 +26,67 @@
 #include "cvd_fast.h"
 //#include "faster_block.h"
 #include "faster_detector.h"
+#include "thread_pool.h"
 
 #include <memory>
 #include <cstdlib>
+#include <algorithm>
+#include <thread>
 #include <gvars3/instances.h>
 
 using namespace std;
 using namespace CVD;
 using namespace GVars3;
 
-/** This takes a detector which requires a threshold and uses binary search to get as
-close as possible to the requested number of corners.
+/** This picks whichever of two thresholds gives the number of corners closest to the
+target, once a search has narrowed them down to adjacent thresholds.
+
+@param c The corners at the chosen threshold are returned here.
+@param N The target number of corners.
+@param t_low The lower threshold.
+@param cl The corners detected at \e t_low.
+@param t_high The higher threshold.
+@param ch The corners detected at \e t_high.
+@return The chosen threshold.
+@ingroup gDetect
+*/
+static int closest_threshold(vector<ImageRef>& c, unsigned int N, unsigned int t_low, vector<ImageRef>& cl, unsigned int t_high, vector<ImageRef>& ch)
+{
+	//Pick the closest
+	//If there is ambiguity, go with the lower threshold (more corners).
+	//The only reason for this is that the evaluation code in the FAST-ER
+	//system uses this rule.
+	if( N - ch.size() >= cl.size() - N)
+	{
+		c = cl;
+		return t_low;
+	}
+	else
+	{ 
+		c = ch;
+		return t_high;
+	}
+}
+
+/** This narrows down the threshold to get as close as possible to the requested number
+of corners, by binary search between two thresholds which have already been tried.
+If there is a tie, the lower threshold (more corners) is chosen.
 
 @param i The image in which to detect corners.
 @param c The detected corners to be returned.
 @param N The target number of corners.
 @param detector The corner detector.
+@param t_low The lower threshold.
+@param cl The corners detected at \e t_low.
+@param t_high The higher threshold.
+@param ch The corners detected at \e t_high.
+@return The threshold of the corners returned.
 @ingroup gDetect
 */
-int binary_search_threshold(const Image<CVD::byte>& i, vector<ImageRef>& c, unsigned int N, const DetectT& detector)
+static int bisect_threshold(const Image<CVD::byte>& i, vector<ImageRef>& c, unsigned int N, const DetectT& detector, unsigned int t_low, vector<ImageRef>& cl, unsigned int t_high, vector<ImageRef>& ch)
 {
-	//Corners for high, low and midpoint thresholds.
-	vector<ImageRef> ch, cl, cm;
-	
-	//The high and low thresholds.
-	unsigned int t_high = 256;
-	unsigned int t_low = 0;
-
-
-	detector(i, ch, t_high);
-	detector(i, cl, t_low);
+	//Corners for the midpoint threshold.
+	vector<ImageRef> cm;
 
 	while(t_high > t_low + 1)
 	{
@@ -81,24 +112,241 @@ int binary_search_threshold(const Image<CVD::byte>& i, vector<ImageRef>& c, unsi
 		}
 	}
 
-	//Pick the closest
-	//If there is ambiguity, go with the lower threshold (more corners).
-	//The only reason for this is that the evaluation code in the FAST-ER
-	//system uses this rule.
-	if( N - ch.size() >= cl.size() - N)
+	return closest_threshold(c, N, t_low, cl, t_high, ch);
+}
+
+/** This takes a detector which requires a threshold and uses binary search to get as
+close as possible to the requested number of corners.
+
+@param i The image in which to detect corners.
+@param c The detected corners to be returned.
+@param N The target number of corners.
+@param detector The corner detector.
+@return The threshold of the corners returned.
+@ingroup gDetect
+*/
+int binary_search_threshold(const Image<CVD::byte>& i, vector<ImageRef>& c, unsigned int N, const DetectT& detector)
+{
+	//Corners for high and low thresholds.
+	vector<ImageRef> ch, cl;
+	
+	//The high and low thresholds.
+	unsigned int t_high = 256;
+	unsigned int t_low = 0;
+
+
+	detector(i, ch, t_high);
+	detector(i, cl, t_low);
+
+	return bisect_threshold(i, c, N, detector, t_low, cl, t_high, ch);
+}
+
+/** This takes a detector which requires a threshold and searches for the threshold 
+which gets as close as possible to the requested number of corners, starting from a
+guess. The search tries thresholds 1, 2, 4, ... away from the guess until the
+target is bracketed, and then uses binary search within the bracket. If the guess
+is good, the detector is run only once or twice.
+
+If the number of corners never increases with the threshold, then the result is
+the same as binary_search_threshold().
+
+@param i The image in which to detect corners.
+@param c The detected corners to be returned.
+@param N The target number of corners.
+@param detector The corner detector.
+@param t The initial guess for the threshold.
+@return The threshold of the corners returned.
+@ingroup gDetect
+*/
+int warm_start_threshold(const Image<CVD::byte>& i, vector<ImageRef>& c, unsigned int N, const DetectT& detector, unsigned int t)
+{
+	vector<ImageRef> ch, cl;
+	unsigned int t_high = min(t, 256u);
+	unsigned int t_low = t_high;
+
+	detector(i, cl, t_low);
+	if(cl.size() == N)
 	{
 		c = cl;
 		return t_low;
 	}
-	else
-	{ 
-		c = ch;
-		return t_high;
+
+	//If there are too many corners, then the threshold needs to go up.
+	bool up = cl.size() > N;
+	if(!up)
+		ch.swap(cl);
+
+	for(unsigned int step=1; ; step *= 2)
+	{
+		if(up)
+		{
+			t_high = min(t_low + step, 256u);
+			ch.clear();
+			detector(i, ch, t_high);
+
+			if(ch.size() == N)
+			{
+				c = ch;
+				return t_high;
+			}
+			else if(ch.size() < N || t_high == 256)
+				break;
+
+			t_low = t_high;
+			cl.swap(ch);
+		}
+		else
+		{
+			t_low = t_high > step ? t_high - step : 0;
+			cl.clear();
+			detector(i, cl, t_low);
+
+			if(cl.size() == N)
+			{
+				c = cl;
+				return t_low;
+			}
+			else if(cl.size() > N || t_low == 0)
+				break;
+
+			t_high = t_low;
+			ch.swap(cl);
+		}
 	}
+
+	return bisect_threshold(i, c, N, detector, t_low, cl, t_high, ch);
 }
 
+///List the thresholds which binary search between two thresholds might try in the next few
+///steps, whatever the results of the detector are.
+///@param t_low The lower threshold.
+///@param t_high The higher threshold.
+///@param levels Number of steps of the binary search.
+///@param t The thresholds are appended to this.
+///@ingroup gDetect
+static void bisection_thresholds(unsigned int t_low, unsigned int t_high, int levels, vector<unsigned int>& t)
+{
+	if(levels == 0 || t_high <= t_low + 1)
+		return;
+
+	unsigned int m = (t_high + t_low) / 2;
+	t.push_back(m);
+	bisection_thresholds(t_low, m, levels - 1, t);
+	bisection_thresholds(m, t_high, levels - 1, t);
+}
+
+/** This does the same search as binary_search_threshold(), but runs the detector at
+several thresholds at once on a pool of threads. Each round runs the detector at every 
+threshold which the binary search might try in its next few steps (\e k thresholds for
+log2(\e k + 1) steps), and then follows the binary search through the results. The
+corners returned are exactly those that binary_search_threshold() would return, for
+any detector, but there are only about 8 / log2(\e k + 1) rounds of detection instead
+of 9 detections in a row. The number of thresholds per round is the largest \e k of
+the form 2^n - 1 that is no larger than the size of the pool, so with a pool of one
+thread this is the ordinary binary search.
+
+The detector is called from several threads at once, so it must be safe to do so.
+
+@param i The image in which to detect corners.
+@param c The detected corners to be returned.
+@param N The target number of corners.
+@param detector The corner detector.
+@param pool The threads to use.
+@return The threshold of the corners returned.
+@ingroup gDetect
+*/
+int kary_search_threshold(const Image<CVD::byte>& i, vector<ImageRef>& c, unsigned int N, const DetectT& detector, thread_pool& pool)
+{
+	int levels = 1;
+	while((2 << levels) - 1 <= pool.size())
+		levels++;
+
+	//Corners for high and low thresholds.
+	vector<ImageRef> ch, cl;
+	
+	//The high and low thresholds.
+	unsigned int t_high = 256;
+	unsigned int t_low = 0;
+
+	//The first detection is run on its own, so that anything the detector sets up
+	//the first time it is used (such as GVars) is not set up from several threads.
+	detector(i, ch, t_high);
+
+	for(bool first=true; t_high > t_low + 1; first=false)
+	{
+		vector<unsigned int> t;
+		if(first)
+			t.push_back(t_low);
+		bisection_thresholds(t_low, t_high, levels, t);
+
+		vector<vector<ImageRef> > r(t.size());
+		pool.run(t.size(), [&](int j)
+		{
+			detector(i, r[j], t[j]);
+		});
+
+		if(first)
+			cl.swap(r[0]);
+
+		//Follow the binary search through the results.
+		for(int l=0; l < levels && t_high > t_low + 1; l++)
+		{
+			unsigned int m = (t_high + t_low) / 2;
+			vector<ImageRef>& cm = r[find(t.begin(), t.end(), m) - t.begin()];
+
+			if(cm.size() == N)
+			{
+				c = cm;
+				return m;
+			}
+			else if(cm.size() < N)
+			{
+				t_high = m;
+				ch.swap(cm);
+			}
+			else
+			{
+				t_low = m;
+				cl.swap(cm);
+			}
+		}
+	}
+
+	return closest_threshold(c, N, t_low, cl, t_high, ch);
+}
+
+///A ::DetectT which selects corners from a list of scored corners (see DetectT::detect_scored()),
+///rather than detecting them. This allows ::binary_search_threshold to pick exactly
+///the same corners as it would with the original detector, without rerunning it.
+///@ingroup gDetect
+struct ScoredCorners:public DetectT
+{
+	///@param c Corners
+	///@param s Score of each corner
+	ScoredCorners(const vector<ImageRef>& c, const vector<int>& s)
+	:corners(c),scores(s)
+	{
+	}
+
+	///Select corners
+	///@param c Corners with a score of at least the threshold are inserted in to this container
+	///@param t Threshold
+	virtual void operator()(const Image<CVD::byte>&, vector<ImageRef>& c, unsigned int t)const
+	{
+		for(unsigned int i=0; i < corners.size(); i++)
+			if(scores[i] >= static_cast<int>(t))
+				c.push_back(corners[i]);
+	}
+
+	private:
+	const vector<ImageRef>& corners; ///< Corners
+	const vector<int>& scores;       ///< Score of each corner
+};
+
 ///This class wraps a ::DetectT class with ::binary_search_threshold and presents
-///is as a DetectN class.
+///is as a DetectN class. If the detector can detect corners at every threshold at once
+///(see DetectT::detect_scored()), then it is only run once, and the search is performed
+///on the scores.
 ///@ingroup gDetect
 struct SearchThreshold:public DetectN
 {
@@ -114,7 +362,13 @@ struct SearchThreshold:public DetectN
 	///@param N number of corners to detect
 	virtual void operator()(const Image<CVD::byte>& im, vector<ImageRef>& corners, unsigned int N)const
 	{
-		int t = binary_search_threshold(im, corners, N, *detector);	
+		vector<ImageRef> all;
+		vector<int> scores;
+
+		if(detector->detect_scored(im, all, scores))
+			binary_search_threshold(im, corners, N, ScoredCorners(all, scores));
+		else
+			binary_search_threshold(im, corners, N, *detector);	
 	}
 	
 	private: 
@@ -122,6 +376,115 @@ struct SearchThreshold:public DetectN
 	unique_ptr<DetectT> detector; 
 };
 
+///This class wraps a ::DetectT class with ::warm_start_threshold and presents it as
+///a DetectN class. It is intended for sequences of similar images, such as video,
+///where the right threshold changes little from one image to the next: the search
+///starts from the threshold found for the previous image, so in the steady state, the
+///detector is run once or twice per image instead of about nine times. The first
+///image is searched with ::binary_search_threshold.
+///
+///The object remembers the previous threshold, so each sequence of images needs its
+///own object.
+///@ingroup gDetect
+struct WarmStartThreshold:public DetectN
+{
+	///@param d Detector to wrap. This will be managed by WarmStartThreshold
+	WarmStartThreshold(DetectT* d)
+	:detector(d),threshold(-1)
+	{
+	}
+    
+	///Detect corners
+	///@param im Image in which to detect corners
+	///@param corners Detected corners are inserted in to this array
+	///@param N number of corners to detect
+	virtual void operator()(const Image<CVD::byte>& im, vector<ImageRef>& corners, unsigned int N)const
+	{
+		vector<ImageRef> all;
+		vector<int> scores;
+
+		if(detector->detect_scored(im, all, scores))
+			threshold = binary_search_threshold(im, corners, N, ScoredCorners(all, scores));
+		else if(threshold < 0)
+			threshold = binary_search_threshold(im, corners, N, *detector);
+		else
+			threshold = warm_start_threshold(im, corners, N, *detector, threshold);
+	}
+	
+	private: 
+	///Detector to wrap
+	unique_ptr<DetectT> detector; 
+	///Threshold found for the previous image, or -1 if there was none.
+	mutable int threshold;
+};
+
+///This class wraps a ::DetectT class with ::kary_search_threshold and presents it as
+///a DetectN class. The results are the same as ::SearchThreshold, but the detector is
+///run at several thresholds at once, which reduces the latency for detectors such as 
+///SUSAN which can not compute scores (see DetectT::detect_scored()).
+///@ingroup gDetect
+struct KarySearchThreshold:public DetectN
+{
+	///@param d Detector to wrap. This will be managed by KarySearchThreshold
+	///@param threads Number of thresholds to try at once
+	KarySearchThreshold(DetectT* d, int threads)
+	:detector(d),pool(new thread_pool(threads))
+	{
+	}
+    
+	///Detect corners
+	///@param im Image in which to detect corners
+	///@param corners Detected corners are inserted in to this array
+	///@param N number of corners to detect
+	virtual void operator()(const Image<CVD::byte>& im, vector<ImageRef>& corners, unsigned int N)const
+	{
+		vector<ImageRef> all;
+		vector<int> scores;
+
+		if(detector->detect_scored(im, all, scores))
+			binary_search_threshold(im, corners, N, ScoredCorners(all, scores));
+		else
+			kary_search_threshold(im, corners, N, *detector, *pool);
+	}
+	
+	private: 
+	///Detector to wrap
+	unique_ptr<DetectT> detector; 
+	///Threads used to run the detector
+	unique_ptr<thread_pool> pool;
+};
+
+///Wrap a ::DetectT so that it can be used as a ::DetectN. The \c threshold_search GVar 
+///selects ::SearchThreshold (\c binary), ::KarySearchThreshold (\c kary) or ::WarmStartThreshold 
+///(\c warm_start). The \c threshold_search.threads GVar gives the number of threads used by
+///::KarySearchThreshold, where 0 means one per hardware thread.
+///@param d Detector to wrap. This will be managed by the returned object.
+///@return The wrapped detector.
+///@ingroup gDetect
+static unique_ptr<DetectN> search_threshold(DetectT* d)
+{
+	string s = GV3::get<string>("threshold_search", "binary", 1);
+
+	if(s == "binary")
+		return unique_ptr<DetectN>(new SearchThreshold(d));
+	else if(s == "kary")
+	{
+		int threads = GV3::get<int>("threshold_search.threads", 0, 1);
+		if(threads <= 0)
+			threads = max(1u, thread::hardware_concurrency());
+
+		return unique_ptr<DetectN>(new KarySearchThreshold(d, threads));
+	}
+	else if(s == "warm_start")
+		return unique_ptr<DetectN>(new WarmStartThreshold(d));
+	else
+	{
+		delete d;
+		cerr << "Unknown threshold search: " << s << endl;
+		exit(1);
+	}
+}
+
 ///@ingroup gDetect
 ///Detector which randomly scatters corners around an image.
 struct Random:public DetectN
@@ -152,6 +515,8 @@ struct Random:public DetectN
 ///          scoring algorithm, as seen in [Rosten, Drummond 2006].
 ///  - \link ::fast_12 fast12\endlink libCVD's builtin FAST-12 detector
 ///  - \link ::faster_learn faster2\endlink A FAST-ER detector loaded from a file containing the tree
+///
+///Detectors which take a threshold are wrapped by search_threshold().
 ///@ingroup gDetect
 unique_ptr<DetectN> get_detector()
 {
@@ -170,16 +535,16 @@ unique_ptr<DetectN> get_detector()
 		return unique_ptr<DetectN>(new HarrisDetect);
 	#ifdef USESUSAN
 		else if(d == "susan")
-			return unique_ptr<DetectN>(new SearchThreshold(new SUSAN));
+			return search_threshold(new SUSAN);
 	#endif
 	else if(d == "fast9")
-		return unique_ptr<DetectN>(new SearchThreshold(new fast_9));
+		return search_threshold(new fast_9);
 	else if(d == "fast9old")
-		return unique_ptr<DetectN>(new SearchThreshold(new fast_9_old));
+		return search_threshold(new fast_9_old);
 	else if(d == "fast12")
-		return unique_ptr<DetectN>(new SearchThreshold(new fast_12));
+		return search_threshold(new fast_12);
 	else if(d == "faster2")
-		return unique_ptr<DetectN>(new SearchThreshold(new faster_learn(GV3::get<string>("faster2"))));
+		return search_threshold(new faster_learn(GV3::get<string>("faster2")));
 	else
 	{
 		cerr << "Unknown detector: " << d << endl;
@@ -49,6 +49,18 @@ struct DetectT
 	///@param c Detected corners are inserted in to this container
 	///@param N Threshold used to detect corners
 	virtual void operator()(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& c, unsigned int N)const =0;
+
+	///Detect corners at every threshold at once. Each corner is given a score, and the
+	///corners detected at threshold \e t must be exactly the corners returned here with 
+	///a score of at least \e t, in the same order. This allows ::SearchThreshold to run
+	///the detector once, instead of once for every threshold it tries. Detectors which
+	///can not guarantee this return false.
+	///@return Whether the corners and scores were computed.
+	virtual bool detect_scored(const CVD::Image<CVD::byte>&, std::vector<CVD::ImageRef>&, std::vector<int>&) const
+	{
+		return false;
+	}
+
 	///Destroy to object
 	virtual ~DetectT(){}
 };
@@ -54,6 +54,9 @@ This will create the following executables:
  - <code>\link learn_detector.cc learn_detector\endlink</code> This learns a detector from a repeatability dataset.
  - \link extract_features.cc \p extract_features \endlink This extracts features from an image sequence which can be turned in to a decision tree.
  - \link learn_fast_tree.cc \p learn_fast_tree \endlink This learns a FAST decision tree, from extracted data.
+ - \link benchmark_detector.cc \p benchmark_detector \endlink This times and cross-checks the implementations of the compiled FAST-ER detector.
+ - \link detect_large.cc \p detect_large \endlink This detects FAST-ER corners in images too large to fit in memory.
+ - \link convert_tree.cc \p convert_tree \endlink This converts trees between the text and binary formats.
  - Programs for generating code from the learned tree, in various language/library combinations.
    - C++ / libCVD
        - \p fast_tree_to_cxx_score_bsearch
@@ -48,6 +48,7 @@ features should be extracted are specified on the commandline.
 #include <string>
 #include "offsets.h"
 #include "faster_tree.h"
+#include "tree_file.h"
 
 using namespace std;
 using namespace CVD;
@@ -112,7 +113,7 @@ int main(int argc, char** argv)
 	string fname=GV3::get<string>("detector", "best_faster.tree");
 	
 	//Load a detector from a tree file
-	tree_element* faster_detector;
+	flat_tree file_tree;
 
 	ifstream i;
 	i.open(fname.c_str());
@@ -124,13 +125,14 @@ int main(int argc, char** argv)
 	}
 	
 	try{
-		faster_detector = load_a_tree(i);
+		file_tree = load_tree_file(fname);
 	}
 	catch(ParseError p)
 	{
 		cerr << "Parse error in " << fname << endl;
 		exit(1);
 	}
+	const tree_element* faster_detector = file_tree.tree();
 
 	//Iterate over all images, extracting features
 	for(int i=lastarg; i < argc; i++)
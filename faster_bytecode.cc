@@ -20,22 +20,41 @@
 #include "faster_bytecode.h"
 #include <cvd/image.h>
 #include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <tuple>
 
 ///\cond never
 using namespace CVD;
 using namespace std;
 ///\endcond
 
-#ifdef JIT
+#ifdef JIT_X86_64
 #include <sys/mman.h>
-///This struct contains a x86 machine-code compiled version of the detector. The detector
-///operates on a single row and inserts offset from the beginning of the image in to a 
-///std::vector. 
+///This class contains a x86-64 machine-code compiled version of the detector. The
+///compiled code follows the System V AMD64 calling convention and contains two
+///procedures. The first is equivalent to:
+///@code
+///int detect(const byte* p, int n, int threshold, int* corners, long stride, int capacity)
+///@endcode
+///It runs the detector on the \c n pixels starting at \c p and writes the number of
+///pixels remaining (including itself) at each detected corner in to \c corners, returning 
+///the number of corners found. It stops early if \c capacity corners are found. The second is equivalent to:
+///@code
+///void score(const byte* base, const int* corners, int n, int threshold, int* scores, long stride)
+///@endcode
+///and computes the score (see block_bytecode::score()) of each of the \c n corners at
+///<code>base + corners[i]</code>, keeping the threshold in a register throughout.
+///
+///The row stride is held in a register, so the same code works on images of any width.
+///
+///The code is written in to read/write memory which is then remapped as read/execute,
+///so the mapping is never writable and executable at the same time.
 ///@ingroup gFastTree
 class jit_detector
 {
 	public:
-		
 
 		///Run the compiled detector on a row of an image.
 		///@param im The image.
@@ -44,300 +63,1038 @@ class jit_detector
 		///@param  xmax The ending position.
 		///@param corners The detected corners as offsets from image.data().
 		///@param threshold The corner detector threshold.
-		void detect_in_row(const Image<byte>& im, int row, int xmin, int xmax, vector<int>& corners, int threshold)
+		void detect_in_row(const SubImage<byte>& im, int row, int xmin, int xmax, vector<int>& corners, int threshold) const
 		{
+			int n = xmax - xmin;
+
+			if(n <= 0)
+				return;
+
+			//Make space for the worst case, and let the machine code write directly
+			//in to the vector.
+			const size_t start = corners.size();
+			corners.resize(start + n);
 
 			const byte* p = im[row] + xmin;
-			const int n = xmax - xmin;
-			void* cs = &corners;
-			const void* im_data = im.data();
-			/* r/m usage, at entry to machine code
-				In use:
-					%ecx				Num remaining
-					%edi 				threshold
-					%ebp 			    Detect in row machine code procedure address
-					%ebx				cb
-					%edx				c_b
-					%esi				data
-					%eax				Scratch
-
-					4%esp 				%esi: produced automatically by call
-					8%esp				image.data()
-					12%esp				&vector<int>
-					16%esp				vector_inserter: simple function for calling member of std::vector
-
-
-				Input:	
-					0 num remaining
-					1 data pointer
-					2 threshold
-					3 proc 
-					4 push_back_proc
-					5 vector<int>
-					6 image.data()
-			*/
+			int num = run(im, p, n, &corners[start], n, threshold);
 
-			__asm__ __volatile__(
-				//Save all registers
-				"	pusha								\n"
-				
-				//Load operands in to correct places
-				"	pushl			%4					\n"
-				"	pushl			%5					\n"
-				"	pushl			%6					\n"
-				"	movl			%0, %%ecx			\n"	
-				"	movl			%1, %%esi			\n"
-				"	movl			%2, %%edi			\n"
-				" 	movl			%3, %%ebp			\n"   //%? uses ebp, so trash ebp last
+			corners.resize(start + num);
+		}
 
-				
-				//Start the loop
-				"	cmp				$0, %%ecx			\n"
-				"	je				1					\n"
-				"	call			*%%ebp				\n"
-				"1:										\n"
+		///Run the compiled detector on a row of an image, writing the corners in to
+		///a fixed size buffer.
+		///@param im The image.
+		///@param row The row to detect corners in.
+		///@param xmin The starting position.
+		///@param  xmax The ending position.
+		///@param corners The detected corners as offsets from image.data().
+		///@param threshold The corner detector threshold.
+		void detect_in_row(const SubImage<byte>& im, int row, int xmin, int xmax, corner_buffer& corners, int threshold) const
+		{
+			//Corners which do not fit are written here, so that they can be counted.
+			int spill[64];
 
+			const byte* p = im[row] + xmin;
+			int n = xmax - xmin;
 
-				//Unload operands
-				"	popl			%%eax				\n"
-				"	popl			%%eax				\n"
-				"	popl			%%eax				\n"
+			while(n > 0 && !(corners.policy == corner_buffer::stop && corners.overflowed()))
+			{
+				const int room = corners.capacity - corners.size;
+				int num;
 
-				//Restore all registers
-				"	popa								\n"
-				:
-				: "m"(n), "m"(p), "m"(threshold), "m"(proc), "i"(&vector_inserter), "m"(cs), "m"(im_data)
-			);
+				if(room)
+				{
+					num = run(im, p, n, corners.data + corners.size, room, threshold);
+					corners.size += num;
+				}
+				else
+					num = run(im, p, n, spill, corners.policy == corner_buffer::stop ? 1 : 64, threshold);
 
+				corners.found += num;
+			}
+		}
 
+		///Compute the scores of a list of corners.
+		///@param base Pointer to the start of the image.
+		///@param stride Row stride of the image.
+		///@param corners Corners, as offsets from \c base.
+		///@param n Number of corners.
+		///@param threshold The corner detector threshold.
+		///@param scores The scores are written here.
+		void score(const byte* base, int stride, const int* corners, int n, int threshold, int* scores) const
+		{
+			reinterpret_cast<void (*)(const byte*, const int*, int, int, int*, long)>(proc + score_start)(base, corners, n, threshold, scores, stride);
 		}
 
+		///Did the compilation succeed? Compilation can fail if the operating system
+		///refuses to map memory as executable.
+		bool ok() const
+		{
+			return proc != 0;
+		}
 
 		///Create a compiled detector from the bytecode.
 		///@param v Bytecode.
 		jit_detector(const vector<block_bytecode::fast_detector_bit>& v)
+		:proc(0),length(0)
+		{
+			vector<unsigned char> code;
+			compile_detector(v, code);
+			score_start = code.size();
+			compile_scorer(v, code);
+
+			//Map a writable block of memory, copy in the code and then make it executable
+			//but no longer writable.
+			length = code.size();
+			void* m = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(m == MAP_FAILED)
+			{
+				cerr << "mmap failed with error: " << strerror(errno) << endl;
+				return;
+			}
+
+			memcpy(m, &code[0], length);
+
+			if(mprotect(m, length, PROT_READ | PROT_EXEC) != 0)
+			{
+				cerr << "mprotect failed with error: " << strerror(errno) << endl;
+				munmap(m, length);
+				return;
+			}
+
+			proc = static_cast<unsigned char*>(m);
+		}
+
+		///Destroy object, unmapping executable memory.
+		~jit_detector()
+		{
+			if(proc)
+				munmap(proc, length);
+		}
+
+	private:
+		///Prevent copying
+		void operator=(const jit_detector&);
+		///Prevent copying
+		jit_detector(const jit_detector&);
+
+		///Run the machine code on part of a row, stopping early if the output fills up.
+		///@param im The image.
+		///@param p First pixel to examine. This is advanced past the pixels examined.
+		///@param n Number of pixels to examine. This is reduced by the number of pixels examined.
+		///@param corners The detected corners are written here, as offsets from image.data().
+		///@param capacity Maximum number of corners to detect.
+		///@param threshold The corner detector threshold.
+		///@return Number of corners detected.
+		int run(const SubImage<byte>& im, const byte*& p, int& n, int* corners, int capacity, int threshold) const
 		{
-			//blocksize
-			const int bs=28;
-
-			length = bs * (v.size() + 2); //Add head and tail block
-
-			/* The original assembler code looked like this
-			   This is now done in machine code, with the whole tree in
-			   place of  line 0x804e0c1.
-
-			 804e0b3:	83 f9 00             	cmp    $0x0,%ecx
-			 804e0b6:	74 1b                	je     804e0d3 <finished>
-
-			0804e0b8 <loop>:
-			 804e0b8:	0f b6 16             	movzbl (%esi),%edx
-			 804e0bb:	89 d3                	mov    %edx,%ebx
-			 804e0bd:	29 fa                	sub    %edi,%edx
-			 804e0bf:	01 fb                	add    %edi,%ebx
-			 804e0c1:	ff d5                	call   *%ebp
-			 804e0c3:	a8 ff                	test   $0xff,%al
-			 804e0c5:	74 08                	je     804e0cf <nocorner>
-			 804e0c7:	56                   	push   %esi
-			 804e0c8:	51                   	push   %ecx
-			 804e0c9:	ff 54 24 10          	call   *0x10(%esp)
-			 804e0cd:	59                   	pop    %ecx
-			 804e0ce:	58                   	pop    %eax
-
-			0804e0cf <nocorner>:
-			 804e0cf:	46                   	inc    %esi
-			 804e0d0:	49                   	dec    %ecx
-			 804e0d1:	75 e5                	jne    804e0b8 <loop>			//jne == jnz
-
-		  	Unused spaces are filled in with int $3, (instruction 0xcc), which
-			causes a debug trap. Makes catching errors easier.
+			int num = reinterpret_cast<int (*)(const byte*, int, int, int*, long, int)>(proc)(p, n, threshold, corners, im.row_stride(), capacity);
+
+			//Convert the number of pixels remaining to the position in the image.
+			const int end = p - im.data() + n;
+			for(int i=0; i < num; i++)
+				corners[i] = end - corners[i];
+
+			//If the output filled up, then the detector stopped after the last corner.
+			const int examined = num == capacity ? corners[num-1] + 1 - (p - im.data()) : n;
+			p += examined;
+			n -= examined;
+
+			return num;
+		}
+		
+		///Helper for assembling machine code with forward and backward jumps. Jump 
+		///destinations are bytecode blocks (numbered from 0), or labels (numbered
+		///after the blocks). All jumps use 32 bit displacements, which are filled
+		///in by finish() once the position of every block and label is known.
+		struct assembler
+		{
+			///@param c Code is appended to this
+			///@param blocks Number of bytecode blocks
+			///@param labels Number of labels
+			assembler(vector<unsigned char>& c, int blocks, int labels)
+			:code(c),pos(blocks + labels, -1),num_blocks(blocks)
+			{}
+
+			vector<unsigned char>& code;       ///< Machine code
+			vector<pair<int, int> > fixups;    ///< Positions of jump displacements and their destination
+			vector<int> pos;                   ///< Positions of blocks and labels
+			int num_blocks;                    ///< Number of bytecode blocks
+
+			///Append some instructions
+			///@param c Instructions
+			template<int N> void add(const unsigned char (&c)[N])
+			{
+				code.insert(code.end(), c, c+N);
+			}
+
+			///Append a 32 bit little endian integer.
+			///@param i The integer
+			void add_int(int i)
+			{
+				unsigned char b[4];
+				memcpy(b, &i, 4);
+				code.insert(code.end(), b, b+4);
+			}
+
+			///Append a placeholder for a jump displacement.
+			///@param dest Destination block or label
+			void add_jump(int dest)
+			{
+				fixups.push_back(make_pair((int)code.size(), dest));
+				add_int(0);
+			}
+
+			///Place a block at the current position.
+			///@param b Block number
+			void place_block(int b)
+			{
+				pos[b] = code.size();
+			}
+
+			///Place a label at the current position.
+			///@param l Label number
+			void place_label(int l)
+			{
+				pos[num_blocks + l] = code.size();
+			}
+
+			///Fill in all the jump displacements.
+			void finish()
+			{
+				for(unsigned int i=0; i < fixups.size(); i++)
+				{
+					int rel = pos[fixups[i].second] - (fixups[i].first + 4);
+					memcpy(&code[fixups[i].first], &rel, 4);
+				}
+			}
+		};
+
+		///Compile the corner detector. 
+		///@param v Bytecode
+		///@param c Machine code is appended to this.
+		static void compile_detector(const vector<block_bytecode::fast_detector_bit>& v, vector<unsigned char>& c)
+		{
+			/* Register usage within the machine code:
+
+				%rdi 		Current pixel pointer (argument 1)
+				%esi		Number of pixels remaining (argument 2)
+				%edx 		threshold (argument 3)
+				%rcx 		Output array (argument 4)
+				%r8 		Row stride (argument 5)
+				%ebx		Capacity of the output array (argument 6, moved from %r9d)
+				%r9d		cb
+				%r10d		c_b
+				%r11d		Number of corners found
+				%eax		Scratch
+
+			   Only %rbx is callee-saved, so it is the only register saved on the stack.
+			
+			   Each tree node compiles to:
+
+				imul     $YYYY, %r8, %rax    (omitted if YYYY is 0)
+				movzbl   XXXX(%rdi,%rax),%eax
+				cmp      %r9d, %eax          
+				jg       GT
+				cmp      %eax, %r10d          
+				jg       LT
+				jmp      EQ                  (omitted if EQ is the next block)
+
+			   Jumps to leaves are redirected to the corner or loop continuation code, 
+			   so leaves do not appear in the machine code at all.
+			*/
+
+			const unsigned char loop_head_1[] = 
+			{
+				0x53,									//push   %rbx
+				0x44, 0x89, 0xcb,						//mov    %r9d,%ebx				Capacity
+				0x45, 0x31, 0xdb,						//xor    %r11d,%r11d			No corners yet
+				0x85, 0xf6,								//test   %esi,%esi
+				0x0f, 0x8e,								//jle    <done>
+			};
+
+			const unsigned char loop_head_2[] = 
+			{
+				0x44, 0x0f, 0xb6, 0x0f,					//movzbl (%rdi),%r9d			Load data
+				0x45, 0x89, 0xca,						//mov    %r9d,%r10d
+				0x41, 0x01, 0xd1,						//add    %edx,%r9d				Compute cb
+				0x41, 0x29, 0xd2,						//sub    %edx,%r10d				Compute c_b
+			};
+
+			const unsigned char row[] = 
+			{
+				0x49, 0x69, 0xc0,						//imul   $YYYY,%r8,%rax
+			};
+
+			const unsigned char load_row[] = 
+			{
+				0x0f, 0xb6, 0x84, 0x07,					//movzbl XXXX(%rdi,%rax),%eax
+			};
+
+			const unsigned char load[] = 
+			{
+				0x0f, 0xb6, 0x87,						//movzbl XXXX(%rdi),%eax
+			};
+
+			const unsigned char branch_2[] = 
+			{
+				0x44, 0x39, 0xc8,						//cmp    %r9d,%eax				(eax - r9d) = data[##]-cb
+				0x0f, 0x8f,								//jg     GT
+			};
+
+			const unsigned char branch_3[] = 
+			{
+				0x41, 0x39, 0xc2,						//cmp    %eax,%r10d				(r10d - eax) = c_b - data[##]
+				0x0f, 0x8f,								//jg     LT
+			};
+
+			const unsigned char corner[] = 
+			{
+				0x42, 0x89, 0x34, 0x99,					//mov    %esi,(%rcx,%r11,4)		Store the number of pixels remaining
+				0x41, 0xff, 0xc3,						//inc    %r11d
+				0x41, 0x39, 0xdb,						//cmp    %ebx,%r11d
+				0x0f, 0x84,								//je     <done>					Output is full
+			};
+
+			const unsigned char loop_tail[] = 
+			{
+				0x48, 0xff, 0xc7,						//inc    %rdi
+				0xff, 0xce,								//dec    %esi
+				0x0f, 0x85,								//jnz    <loop>
+			};
+
+			const unsigned char done[] = 
+			{
+				0x44, 0x89, 0xd8,						//mov    %r11d,%eax				Return number of corners
+				0x5b,									//pop    %rbx
+				0xc3,									//ret
+			};
 			
-			The consists of fixed sized blocks pasted together. The size is determined by the
-			largest block, which is a tree node. This makes jump computation trivial, but 
-			it also means that short jumps are never used, and the code is therefore larger
-			than necessary.
+			enum {label_corner, label_continue, label_loop, label_done, num_labels};
+			const int n = v.size();
+			assembler a(c, n, num_labels);
+
+			a.add(loop_head_1);
+			a.add_jump(n + label_done);
+
+			a.place_label(label_loop);
+			a.add(loop_head_2);
+
+			compile_tree(v, a, [&](const block_bytecode::fast_detector_bit& b){ add_load(a, row, load_row, load, b); }, branch_2, branch_3, n + label_corner, n + label_continue);
+
+			a.place_label(label_corner);
+			a.add(corner);
+			a.add_jump(n + label_done);
+
+			a.place_label(label_continue);
+			a.add(loop_tail);
+			a.add_jump(n + label_loop);
+
+			a.place_label(label_done);
+			a.add(done);
+
+			a.finish();
+		}
 
-			The rest have 0xcc filled in in the spare places. 
+		///Compile the corner scorer. This computes the score in the same way as
+		///block_bytecode::score(), by repeatedly running the detector with the
+		///threshold raised by the margin by which the previous run passed.
+		///@param v Bytecode
+		///@param c Machine code is appended to this.
+		static void compile_scorer(const vector<block_bytecode::fast_detector_bit>& v, vector<unsigned char>& c)
+		{
+			/* Register usage within the machine code:
 
-			The blocks are templates and have the relevant parts filled in prior to 
-			copying.
+				%rdi 		Image base pointer (argument 1)
+				%rsi		Pointer to the current corner (argument 2)
+				%edx 		Number of corners remaining (argument 3)
+				%ecx 		threshold + 1 (argument 4)
+				%r8 		Pointer to the current score (argument 5)
+				%r9 		Row stride (argument 6), then pointer to the current pixel
+				%r13		Row stride
+				%r10d		Current threshold
+				%r11d		cb
+				%ebx		c_b
+				%r12d		Minimum margin by which the current test passed
+				%eax		Scratch
 
-			Each tree node (including leaves are represented by an entire block)
+			   %rbx, %r12 and %r13 are callee-saved, so they are pushed on to the stack.
+			
+			   Each tree node compiles to:
 
-			Detectod corners are inserted in to a vector<int> as the integer offset of the corner
-			pixel from the beginning of the image
+				imul     $YYYY, %r13, %rax   (omitted if YYYY is 0)
+				movzbl   XXXX(%r9,%rax),%eax
+				sub      %r11d, %eax         eax = data[##] - cb
+				jg       1f
+				add      %r11d, %eax
+				neg      %eax
+				add      %ebx, %eax          eax = c_b - data[##]
+				jg       2f
+				jmp      EQ                  
+			1:  cmp      %r12d, %eax
+				cmovl    %eax, %r12d         m = min(m, eax)
+				jmp      GT
+			2:  cmp      %r12d, %eax
+				cmovl    %eax, %r12d
+				jmp      LT
 			*/
 
-			const unsigned char loop_head[bs] = 
+			const unsigned char head[] = 
 			{
-				0xEB, 0x11,							//jmp + 17
+				0x53,									//push   %rbx
+				0x41, 0x54,								//push   %r12
+				0x41, 0x55,								//push   %r13
+				0x4d, 0x89, 0xcd,						//mov    %r9,%r13				Row stride
+				0xff, 0xc1,								//inc    %ecx					Scoring starts at threshold+1
+				0x85, 0xd2,								//test   %edx,%edx
+				0x0f, 0x8e,								//jle    <done>
+			};
 
-				0xcc,0xcc,0xcc,0xcc,0xcc,0xcc,		//dead space
-				0xcc,0xcc,0xcc,0xcc,0xcc,0xcc,
-				0xcc,0xcc,0xcc,0xcc,0xcc,
+			const unsigned char corner_head[] = 
+			{
+				0x4c, 0x63, 0x0e,						//movslq (%rsi),%r9
+				0x49, 0x01, 0xf9,						//add    %rdi,%r9				Pointer to corner
+				0x41, 0x89, 0xca,						//mov    %ecx,%r10d				Initial threshold
+			};
 
+			const unsigned char detect_head[] = 
+			{
+				0x45, 0x0f, 0xb6, 0x19,					//movzbl (%r9),%r11d			Load data
+				0x44, 0x89, 0xdb,						//mov    %r11d,%ebx
+				0x45, 0x01, 0xd3,						//add    %r10d,%r11d			Compute cb
+				0x44, 0x29, 0xd3,						//sub    %r10d,%ebx				Compute c_b
+				0x41, 0xbc, 0xff, 0xff, 0xff, 0x7f,		//mov    $INT_MAX,%r12d
+			};
 
-				0x0f, 0xb6, 0x16,					//movzbl (%esi),%edx			Load data
-				0x89, 0xd3,                			//mov    %edx,%ebx
-				0x29, 0xfa,                			//sub    %edi,%edx				Compute c_b
-				0x01, 0xfb,                			//add    %edi,%ebx				Compute cb
+			const unsigned char row[] = 
+			{
+				0x49, 0x69, 0xc5,						//imul   $YYYY,%r13,%rax
 			};
-			const int loop_head_start=19;			//Jump to here to continue loop
 
+			const unsigned char load_row[] = 
+			{
+				0x41, 0x0f, 0xb6, 0x84, 0x01,			//movzbl XXXX(%r9,%rax),%eax
+			};
 
-			unsigned char loop_tail[bs] = 
+			const unsigned char load[] = 
 			{
-				0x56,								//push %esi				Functions seem to trash this otherwise
-				0x51,								//push %ecx				Functions seem to trash this otherwise
-				0xFF, 0x54, 0x24, 0x14,				//call *16(%esp)		Other arguments on the stack already
-				0x59,								//pop %ecx				Clean stack
-				0x58,								//pop %eax				...
-				
-				0x46,								//inc %esi
-				0x49,								//dec %ecx
-				0x0F, 0x85, 0xcc, 0xcc, 0xcc, 0xcc,	//jnz <back to first block>
-
-				0xc3, 								//ret
-				0xcc,0xcc,0xcc,0xcc,  				//dead space 
-				0xcc,0xcc,0xcc,0xcc,
-				0xcc,0xcc,0xcc,
+				0x41, 0x0f, 0xb6, 0x81,					//movzbl XXXX(%r9),%eax
 			};
-			const int loop_tail_address_offset = 12;   //fill in the jump <back to first block> address here
-			const int loop_tail_jump_delta     = 16;   //Jump block_size*depth + this, to loop.
-			const int loop_tail_entry		   = 8;    //jump to here to avoid inserting current point as corner
-
-			unsigned char cont_or_goto[bs] = 
-			{	
-				0xE9,0xcc, 0xcc, 0xcc, 0xcc,		//Jump to end of loop
-				0xcc,0xcc,0xcc,0xcc,0xcc,0xcc, 		//dead space
-				0xcc,0xcc,0xcc,0xcc,0xcc,0xcc,
-				0xcc,0xcc,0xcc,0xcc,0xcc,0xcc,
-				0xcc,0xcc,0xcc,0xcc,0xcc
+
+			const unsigned char branch_2[] = 
+			{
+				0x44, 0x29, 0xd8,						//sub    %r11d,%eax				
+				0x0f, 0x8f,								//jg     1f
+			};
+
+			const unsigned char branch_3[] = 
+			{
+				0x44, 0x01, 0xd8,						//add    %r11d,%eax				
+				0xf7, 0xd8,								//neg    %eax
+				0x01, 0xd8,								//add    %ebx,%eax
+				0x0f, 0x8f,								//jg     2f
 			};
-			const int cont_jmp_addr = 1;			//Jump address filled in here
-			const int cont_delta = 5;				//This much in addition to block delta
+
+			const unsigned char update_min[] = 
+			{
+				0x44, 0x39, 0xe0,						//cmp    %r12d,%eax
+				0x44, 0x0f, 0x4c, 0xe0,					//cmovl  %eax,%r12d
+			};
+
+			const unsigned char corner[] = 
+			{
+				0x45, 0x01, 0xe2,						//add    %r12d,%r10d			Increase threshold and go again
+			};
+
+			const unsigned char non_corner[] = 
+			{
+				0x41, 0xff, 0xca,						//dec    %r10d
+				0x45, 0x89, 0x10,						//mov    %r10d,(%r8)			Score is the last passing threshold
+				0x48, 0x83, 0xc6, 0x04,					//add    $4,%rsi
+				0x49, 0x83, 0xc0, 0x04,					//add    $4,%r8
+				0xff, 0xca,								//dec    %edx
+				0x0f, 0x85,								//jnz    <corner_loop>
+			};
+
+			const unsigned char done[] = 
+			{
+				0x41, 0x5d,								//pop    %r13
+				0x41, 0x5c,								//pop    %r12
+				0x5b,									//pop    %rbx
+				0xc3,									//ret
+			};
+
+			const unsigned char jump[] = 
+			{
+				0xe9,									//jmp
+			};
+
+			//Every node needs two extra labels for the margin updates
+			enum {label_corner, label_non_corner, label_corner_loop, label_detect, label_done, num_labels};
+			const int n = v.size();
+			assembler a(c, n, num_labels + 2 * n);
 			
-			unsigned char branch[bs] = 
-			{
-				0x0f, 0xB6, 0x86, 0xcc, 0xcc, 0xcc, 0xcc, 	//movzbl   OOOO(%esi),%eax
-				0x39, 0xd8,									//cmp      %ebx, %eax   (eax - ebx) = (data[##]-cb
-				0x0F, 0x8F, 0xcc, 0xcc, 0xcc, 0xcc,			//jg       XXXX         jmp by XXXX if eax > ebx
-				0x39, 0xC2,									//cmp      %eax, %edx   (edx - eax) = c_b - data[##]
-				0x0F, 0x8F, 0xcc, 0xcc, 0xcc, 0xcc,			//jg       YYYY         jmp by YYYY if ecx > ebx
-				0xE9, 0xcc, 0xcc, 0xcc, 0xcc,				//jmp	   ZZZZ			Unconditional jump to ZZZZ
+			//Label number for the margin update for the gt (0) or lt (1) branch of node i
+			auto margin_label = [&](int i, int branch)
+			{
+				return num_labels + 2*i + branch;
+			};
+
+			//Leaves are not compiled: jumps go straight to the corner or non corner code.
+			auto target = [&](int i)
+			{
+				if(v[i].lt == 0)
+					return n + (v[i].gt ? label_corner : label_non_corner);
+				else
+					return i;
 			};
-			const int block_off_off = 3;
-			const int block_gt_off = 11;
-			const int block_lt_off = 19;
-			const int block_eq_off = 24;
 
+			a.add(head);
+			a.add_jump(n + label_done);
+
+			a.place_label(label_corner_loop);
+			a.add(corner_head);
+
+			a.place_label(label_detect);
+			a.add(detect_head);
 
-			//mmap a writable, executable block of memory for JITted code
-			proc = (unsigned char*) mmap(0, length, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
-			if(proc == MAP_FAILED)
+			if(v[0].lt == 0)
 			{
-				cerr << "mmap failed with error: " << strerror(errno) << endl;
-				exit(1);
+				a.add(jump);
+				a.add_jump(target(0));
 			}
 			
-			//Copy in the loop head: no parts to be filled in.
-			memcpy(proc, loop_head, bs);
+			for(int i=0; i < n; i++)
+			{
+				if(v[i].lt == 0)
+					continue;
+				
+				a.place_block(i);
+				add_load(a, row, load_row, load, v[i]);
+				a.add(branch_2);
+				a.add_jump(n + margin_label(i, 0));
+				a.add(branch_3);
+				a.add_jump(n + margin_label(i, 1));
+				a.add(jump);
+				a.add_jump(target(v[i].eq));
+
+				a.place_label(margin_label(i, 0));
+				a.add(update_min);
+				a.add(jump);
+				a.add_jump(target(v[i].gt));
+
+				a.place_label(margin_label(i, 1));
+				a.add(update_min);
+				a.add(jump);
+				a.add_jump(target(v[i].lt));
+			}
+
+			a.place_label(label_corner);
+			a.add(corner);
+			a.add(jump);
+			a.add_jump(n + label_detect);
+
+			a.place_label(label_non_corner);
+			a.add(non_corner);
+			a.add_jump(n + label_corner_loop);
 
-			for(int i=0; i < (int)v.size(); i++)
+			a.place_label(label_done);
+			a.add(done);
+
+			a.finish();
+		}
+
+		///Append the instructions to load the pixel examined by a node in to %eax. If the 
+		///pixel is on another row, the offset of the row is computed from the stride first.
+		///@param a Assembler
+		///@param row Instructions for multiplying the stride (followed by the y offset)
+		///@param load_row Instructions for loading a pixel on another row (followed by the x offset)
+		///@param load Instructions for loading a pixel on the same row (followed by the x offset)
+		///@param b The node
+		template<int A, int B, int C> static void add_load(assembler& a, const unsigned char (&row)[A], const unsigned char (&load_row)[B], const unsigned char (&load)[C], const block_bytecode::fast_detector_bit& b)
+		{
+			if(b.y == 0)
+				a.add(load);
+			else
 			{
-				if(v[i].lt == 0)			// leaf
-				{
-					if(v[i].gt == 0) //Fill in jump to continue part
-					{
-						*(int*)(cont_or_goto + cont_jmp_addr) = bs * (v.size()- i) - cont_delta + loop_tail_entry;
-					}
-					else //fill in jump to insert part
-					{
-						*(int*)(cont_or_goto + cont_jmp_addr) = bs * (v.size() - i) - cont_delta;
-					}
-						
-
-					memcpy(proc + (i+1)*bs, cont_or_goto, bs);
-				}
+				a.add(row);
+				a.add_int(b.y);
+				a.add(load_row);
+			}
+
+			a.add_int(b.x);
+		}
+
+		///Compile the tree nodes of the detector. Each node is a load, followed by two
+		///conditional jumps (to GT and LT) and an unconditional jump to EQ.
+		///@param v Bytecode
+		///@param a Assembler
+		///@param load Function which appends the instructions for loading the pixel of a node
+		///@param branch_2 Instructions for the GT test (followed by the GT destination)
+		///@param branch_3 Instructions for the LT test (followed by the LT destination)
+		///@param corner Label number for a corner
+		///@param non_corner Label number for a non corner
+		template<class Load, int B, int C> static void compile_tree(const vector<block_bytecode::fast_detector_bit>& v, assembler& a, const Load& load, const unsigned char (&branch_2)[B], const unsigned char (&branch_3)[C], int corner, int non_corner)
+		{
+			const unsigned char jump[] = 
+			{
+				0xe9,									//jmp    EQ
+			};
+
+			//Leaves are not compiled: jumps go straight to the corner or continue code.
+			auto target = [&](int i)
+			{
+				if(v[i].lt == 0)
+					return v[i].gt ? corner : non_corner;
 				else
+					return i;
+			};
+
+			//The root is always the first instruction. If it is a leaf, the test is trivial.
+			if(v[0].lt == 0)
+			{
+				a.add(jump);
+				a.add_jump(target(0));
+			}
+
+			for(unsigned int i=0; i < v.size(); i++)
+			{
+				if(v[i].lt == 0)
+					continue;
+
+				a.place_block(i);
+				load(v[i]);
+				a.add(branch_2);
+				a.add_jump(target(v[i].gt));
+				a.add(branch_3);
+				a.add_jump(target(v[i].lt));
+
+				//Fall through to the next block if possible
+				if(!(v[i].eq == (int)i+1 && v[i+1].lt != 0))
 				{
-					*(int*)(branch+block_off_off)  = v[i].offset;
-
-					//Optimization: leaf nodes have a non-conditional goto in them
-					//so goto the right place directly, rather than the leaf node.
-					//This has a 5% effect or so, so bigger gains elsewhere.
-					//Removed for simplicity.
-					
-					*(int*)(branch+block_gt_off) = (v[i].gt -i) * bs - (block_gt_off + 4);
-					*(int*)(branch+block_lt_off) = (v[i].lt -i) * bs - (block_lt_off + 4);
-					*(int*)(branch+block_eq_off) = (v[i].eq -i) * bs - (block_eq_off + 4);
-
-					memcpy(proc + (i+1)*bs, branch, bs);
+					a.add(jump);
+					a.add_jump(target(v[i].eq));
 				}
 			}
-			
-			//Insert the correct backwards jump for looping
-			*(int*)(loop_tail+loop_tail_address_offset) = -bs * (1+v.size()) - loop_tail_jump_delta + loop_head_start;
-			memcpy(proc + bs * (v.size() + 1), loop_tail, bs);
-
 		}
 
-		///Destroy object, unmapping executable memory.
-		~jit_detector()
+		unsigned char* proc;			///< The machine code is stored in this mmap() allocated data which allows code execution.
+		size_t		   length;			///< Number of mmap() allocated bytes.
+		size_t		   score_start;		///< Position of the scoring procedure in the machine code.
+};
+#endif
+
+///Is JIT compilation of the bytecode available in this build?
+bool block_bytecode::jit_available()
+{
+	#ifdef JIT_X86_64
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+///Compile the bytecode to machine code, if JIT compilation is available. The machine
+///code is held by the bytecode (and shared between copies of it), and is used by
+///subsequent calls to detect(). The bytecode must not be modified afterwards.
+void block_bytecode::compile()
+{
+	#ifdef JIT_X86_64
+		shared_ptr<jit_detector> j(new jit_detector(d));
+		if(j->ok())
+			jit = j;
+	#endif
+}
+
+///Compute the memory offset of the pixel examined by each block, for images with a 
+///given row stride. The interpreter reads these, rather than computing the offsets 
+///for every pixel.
+///@param s Row stride of the images the detector will be used on.
+void block_bytecode::set_stride(int s)
+{
+	for(unsigned int i=0; i < d.size(); i++)
+		d[i].offset = offset(i, s);
+	
+	stride = s;
+}
+
+///Get a version of the bytecode which can be interpreted on an image with a given row
+///stride. If the offsets are not already for that stride, then a copy is made, so the
+///interpreter is fastest on images with the stride given to set_stride().
+///@param s Row stride of the image.
+///@param copy Storage for the copy, if one is needed.
+///@return The bytecode to interpret.
+const block_bytecode& block_bytecode::with_stride(int s, block_bytecode& copy) const
+{
+	if(s == stride)
+		return *this;
+
+	copy.d = d;
+	copy.set_stride(s);
+	return copy;
+}
+
+///Detect corners in an image, which may be a view in to a larger image. The machine 
+///code is used if compile() has been called and was successful, otherwise the bytecode 
+///is interpreted.
+///@param im The image in which to detect corners
+///@param corners Detected corners are inserted in to this container, as offsets from 
+///               <code>im.data()</code>. Rows are <code>im.row_stride()</code> apart.
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+void block_bytecode::detect(const CVD::SubImage<CVD::byte>& im, std::vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const
+{
+	#ifdef JIT_X86_64
+		if(jit)
 		{
-			munmap(proc, length);
+			for(int y = ymin; y < ymax; y++)
+				jit->detect_in_row(im, y, xmin, xmax, corners, threshold);
+			return;
 		}
+	#endif
 
-	private:
-		///Prevent copying
-		void operator=(const jit_detector&);
-		///Prevent copying
-		jit_detector(const jit_detector&);
+	block_bytecode copy;
+	const block_bytecode& b = with_stride(im.row_stride(), copy);
 
-		unsigned char* proc;			///< The machine code is stored in this mmap() allocated data which allows code execution.
-		int			   length;			///< Number of mmap() allocated bytes.
-
-		///Callback function to allow insertion in to std::vector. The execution of this function
-		///relies on the stack having the following layout (stack head on the left):
-		///@code
-		///return_address first_arg second_arg etc...
-		///@endcode
-		///so that the arguemnts directly reflect the stack layout.
-		///For speed, and in order to minimize stack handling, the argument list spans two call instructions worth of stack.
-		///
-		///@param ecx_dummy Pushed by the machine code, since the ABI allows ecx to be trashed
-		///@param p The pointer to the current pixel. Pushed by the machine code.
-		///@param esp_return_dummy Location to return to on a return from the machine code. Generated by the assembler call in to the machine code.
-		///@param im_data Pointer to the first image pixel. Pushed by the assembler caller.
-		///@param i  Pointer to the std::vector<int> which stores the data. Pushed by the assembler caller.
-		static void vector_inserter(int ecx_dummy, const byte* p, const void* esp_return_dummy, const byte* im_data, vector<int>* i)
+	for(int y = ymin; y < ymax; y++)
+		for(int x=xmin; x < xmax; x++)
+			if(b.detect_no_score(&im[y][x], threshold))
+				corners.push_back(&im[y][x] - im.data());
+}
+
+///Detect corners in an image, writing them in to a fixed size buffer, so that
+///no memory is allocated. Otherwise, this is the same as 
+///detect(const CVD::SubImage<CVD::byte>&, std::vector<int>&, int, int, int, int, int) const.
+///@param im The image in which to detect corners
+///@param corners Detected corners are appended to this buffer. See ::corner_buffer for
+///               what happens when it is full.
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+///@return Whether every corner fitted in to the buffer.
+bool block_bytecode::detect(const CVD::SubImage<CVD::byte>& im, corner_buffer& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const
+{
+	#ifdef JIT_X86_64
+		if(jit)
 		{
-			i->push_back(p-im_data);
+			for(int y = ymin; y < ymax && !(corners.policy == corner_buffer::stop && corners.overflowed()); y++)
+				jit->detect_in_row(im, y, xmin, xmax, corners, threshold);
+			return !corners.overflowed();
 		}
-};
-#endif
+	#endif
+
+	block_bytecode copy;
+	const block_bytecode& b = with_stride(im.row_stride(), copy);
+
+	for(int y = ymin; y < ymax; y++)
+		for(int x=xmin; x < xmax; x++)
+			if(b.detect_no_score(&im[y][x], threshold))
+				if(!corners.push(&im[y][x] - im.data()) && corners.policy == corner_buffer::stop)
+					return false;
+
+	return !corners.overflowed();
+}
 
-///Detect corners in an image. The width of the image must match the width the
-///detector was compiled to (using tree_elemeent::make_fast_detector for the
-///results to make sense. The bytecode is JIT coimpiled if possible.
+///Detect corners in the parts of an image covered by a mask. Only the pixels in the runs of
+///the mask are examined, and each run is detected in the same way as a row by 
+///detect(const CVD::SubImage<CVD::byte>&, std::vector<int>&, int, int, int, int, int) const.
 ///@param im The image in which to detect corners
-///@param corners Detected corners are inserted in to this container.
+///@param corners Detected corners are inserted in to this container, as offsets from the start of the image.
 ///@param threshold Corner detector threshold to use
+///@param mask The pixels in which to detect corners.
 ///@param xmin x coordinate to start at.
 ///@param ymin y coordinate to start at.
 ///@param xmax x coordinate to go up to.
 ///@param ymax y coordinate to go up to.
-void block_bytecode::detect(const CVD::Image<CVD::byte>& im, std::vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax)
+void block_bytecode::detect(const CVD::SubImage<CVD::byte>& im, std::vector<int>& corners, int threshold, const run_mask& mask, int xmin, int xmax, int ymin, int ymax) const
 {
-	#ifdef JIT
-		jit_detector jit(d);
-		for(int y = ymin; y < ymax; y++)
-			jit.detect_in_row(im, y, xmin, xmax, corners, threshold);
-	#else
-		cerr << "Hello!\n";
-		for(int y = ymin; y < ymax; y++)
-			for(int x=xmin; x < xmax; x++)
-				if(detect_no_score(&im[y][x], threshold))
-					corners.push_back(&im[y][x] - im.data());
+	for(unsigned int i=0; i < mask.runs.size(); i++)
+	{
+		const run_mask::run& r = mask.runs[i];
+		int x0 = max(r.x0, xmin), x1 = min(r.x1, xmax);
+
+		if(r.y >= ymin && r.y < ymax && x0 < x1)
+			detect(im, corners, threshold, x0, x1, r.y, r.y+1);
+	}
+}
+
+///Make a mask from an image, where non-zero pixels are in the mask.
+///@param mask The image.
+run_mask::run_mask(const CVD::SubImage<CVD::byte>& mask)
+{
+	for(int y=0; y < mask.size().y; y++)
+		for(int x=0; x < mask.size().x; )
+		{
+			int x0 = x;
+			while(x < mask.size().x && mask[y][x])
+				x++;
+
+			add(y, x0, x);
+
+			while(x < mask.size().x && !mask[y][x])
+				x++;
+		}
+}
+
+///Compute the scores of a list of corners. The score is the highest threshold
+///for which the point is still detected as a corner, found by starting at 
+///<code>threshold+1</code> and repeatedly raising the threshold by the margin by 
+///which the detector passed (see detect(const CVD::byte*, int) const), until the
+///point is no longer a corner. The machine code is used if compile() has been 
+///called and was successful, otherwise the bytecode is interpreted.
+///@param base Pointer to the first pixel of the image.
+///@param stride Row stride of the image.
+///@param corners Corners, as offsets from \c base.
+///@param threshold The threshold at which the corners were detected.
+///@param scores The scores are stored here, one for each corner.
+void block_bytecode::score(const CVD::byte* base, int stride, const std::vector<int>& corners, int threshold, std::vector<int>& scores) const
+{
+	scores.resize(corners.size());
+	
+	if(corners.empty())
+		return;
+
+	#ifdef JIT_X86_64
+		if(jit)
+		{
+			jit->score(base, stride, &corners[0], corners.size(), threshold, &scores[0]);
+			return;
+		}
 	#endif
+
+	block_bytecode copy;
+	const block_bytecode& b = with_stride(stride, copy);
+
+	for(unsigned int j=0; j < corners.size(); j++)
+	{
+		int i=threshold + 1;
+		while(1)
+		{
+			int n = b.detect(base + corners[j], i);
+			if(n != 0)
+				i += n;
+			else
+				break;
+		}
+		scores[j] = i-1;
+	}
+}
+
+///Merge structurally identical blocks, so that the bytecode is a minimal graph. Two blocks
+///are identical if they examine the same pixel and branch to identical blocks. Since
+///the detector is applied in every orientation and with intensity inversion, repeated
+///subtrees are common, especially in large trees. Blocks whose three branches all go to 
+///the same place are also removed, since the test makes no difference. The detector is 
+///unchanged: every implementation gives identical results before and after.
+///
+///The root stays as the first block, and ::roots is updated. Any compiled machine code is
+///discarded, so compile() must be called again afterwards.
+///@return The number of blocks removed.
+int block_bytecode::minimise()
+{
+	//Every branch in the bytecode made by tree_element::make_fast_detector goes to a later 
+	//block, so blocks are visited last to first, and the branches of each block have already 
+	//been given a class. Each class of identical blocks is kept as its last block, so that
+	//every branch still goes to a later block, and minimising again changes nothing. The
+	//root has no branches to it, and is never merged, so it stays as the first block.
+	vector<int> cls(d.size());
+	vector<int> keep;
+	map<tuple<int, int, int, int, int>, int> classes;
+
+	for(int i=d.size()-1; i >= 0; i--)
+	{
+		tuple<int, int, int, int, int> k;
+
+		if(d[i].lt == 0)
+			k = make_tuple(0, 0, -1, d[i].gt, -1);
+		else if(cls[d[i].lt] == cls[d[i].gt] && cls[d[i].gt] == cls[d[i].eq] && i != 0)
+		{
+			cls[i] = cls[d[i].eq];
+			continue;
+		}
+		else
+			k = make_tuple(d[i].x, d[i].y, cls[d[i].lt], cls[d[i].gt], cls[d[i].eq]);
+
+		map<tuple<int, int, int, int, int>, int>::iterator c = classes.find(k);
+		if(c == classes.end() || i == 0)
+		{
+			cls[i] = keep.size();
+			classes[k] = keep.size();
+			keep.push_back(i);
+		}
+		else
+			cls[i] = c->second;
+	}
+
+	//Lay out the remaining blocks in their original order.
+	vector<int> pos(keep.size(), -1);
+	vector<fast_detector_bit> m;
+
+	for(unsigned int i=0; i < d.size(); i++)
+		if(keep[cls[i]] == (int)i)
+		{
+			pos[cls[i]] = m.size();
+			m.push_back(d[i]);
+		}
+	
+	for(unsigned int i=0; i < m.size(); i++)
+		if(m[i].lt != 0)
+		{
+			m[i].lt = pos[cls[m[i].lt]];
+			m[i].gt = pos[cls[m[i].gt]];
+			m[i].eq = pos[cls[m[i].eq]];
+		}
+
+	for(unsigned int i=0; i < roots.size(); i++)
+		roots[i] = pos[cls[roots[i]]];
+	
+	int removed = d.size() - m.size();
+	d.swap(m);
+	jit.reset();
+
+	return removed;
+}
+
+///Count how many times each block is visited when detecting corners in an image. The
+///counts can be accumulated over a number of images, and used to lay out the detector
+///(see compact_bytecode).
+///@param im The image in which to detect corners
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+///@param visits The number of visits to each block is added to this.
+void block_bytecode::profile(const CVD::SubImage<CVD::byte>& im, int threshold, int xmin, int xmax, int ymin, int ymax, std::vector<unsigned int>& visits) const
+{
+	detector_profile p;
+	profile(im, threshold, xmin, xmax, ymin, ymax, p);
+
+	visits.resize(d.size());
+	for(unsigned int i=0; i < d.size(); i++)
+		visits[i] += p.visits[i];
 }
 
+///Profile the detector on an image. The nodes of the profile are the blocks, and 
+///the forms are the orientations given by ::roots. The form being run is tracked by
+///the jumps to the roots, so this works after minimise() as well.
+///@param im The image in which to detect corners
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+///@param prof The counts are added to this.
+void block_bytecode::profile(const CVD::SubImage<CVD::byte>& im, int threshold, int xmin, int xmax, int ymin, int ymax, detector_profile& prof) const
+{
+	int forms = roots.size() - 1;
+	prof.resize(d.size(), forms);
+
+	for(int y = ymin; y < ymax; y++)
+		for(int x=xmin; x < xmax; x++)
+		{
+			const byte* imp = &im[y][x];
+			int n=0;	
+			int form=0;
+			int cb = *imp + threshold;
+			int c_b = *imp - threshold;
+
+			prof.pixels++;
+			prof.reached[0]++;
+
+			for(;;)
+			{
+				//A form which does not detect a corner jumps to the root of the next one.
+				while(form < forms && n == roots[form+1])
+					if(++form < forms)
+						prof.reached[form]++;
+
+				prof.visits[n]++;
+
+				if(d[n].lt == 0)
+				{
+					if(d[n].gt)
+						prof.detected[form]++;
+					break;
+				}
+
+				prof.tests[form]++;
+
+				int p = imp[offset(n, im.row_stride())];
+
+				if(p > cb)
+					n = d[n].gt;
+				else if(p < c_b)
+					n = d[n].lt;
+				else
+					n = d[n].eq;
+			}
+		}
+}
+
+///Make room for the counts of a detector, keeping any counts already made. 
+///@param nodes Number of nodes in the detector.
+///@param forms Number of forms in which the detector is run.
+void detector_profile::resize(int nodes, int forms)
+{
+	visits.resize(nodes);
+	reached.resize(forms);
+	detected.resize(forms);
+	tests.resize(forms);
+}
+
+///Write a report of the profile. The report is plain text, with one record per line.
+///The first word of each line says what the line holds:
+///@code
+///detector NAME
+///pixels P
+///tests T
+///tests_per_pixel T/P
+///detected D
+///forms F
+///form I REACHED DETECTED REJECTION_RATE TESTS TESTS_PER_PIXEL_REACHED
+///nodes N
+///node I VISITS VISIT_RATE
+///end
+///@endcode
+///There is one \c form line for each form, in the order in which they are run, and one
+///\c node line for each node. The rejection rate of a form is the fraction of the pixels 
+///reaching it which it does not detect. The visit rate of a node is the number of visits
+///per pixel.
+///@param o The stream to write to.
+///@param detector Name of the detector profiled, which should be a single word.
+void detector_profile::write(std::ostream& o, const std::string& detector) const
+{
+	uint64_t total_tests=0, total_detected=0;
+	for(unsigned int i=0; i < tests.size(); i++)
+	{
+		total_tests += tests[i];
+		total_detected += detected[i];
+	}
+
+	double px = max<uint64_t>(pixels, 1);
+
+	o << "detector " << detector << "\n";
+	o << "pixels " << pixels << "\n";
+	o << "tests " << total_tests << "\n";
+	o << "tests_per_pixel " << total_tests / px << "\n";
+	o << "detected " << total_detected << "\n";
+	o << "forms " << reached.size() << "\n";
+
+	for(unsigned int i=0; i < reached.size(); i++)
+	{
+		double r = max<uint64_t>(reached[i], 1);
+		o << "form " << i << " " << reached[i] << " " << detected[i] << " " << (reached[i] - detected[i]) / r << " " << tests[i] << " " << tests[i] / r << "\n";
+	}
+
+	o << "nodes " << visits.size() << "\n";
+	for(unsigned int i=0; i < visits.size(); i++)
+		o << "node " << i << " " << visits[i] << " " << visits[i] / px << "\n";
+
+	o << "end" << std::endl;
+}
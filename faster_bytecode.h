@@ -21,14 +21,149 @@
 #define FASTER_BYTECODE_H
 
 #include <vector>
+#include <memory>
 #include <climits>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <stdint.h>
 #include <cvd/byte.h>
 #include <cvd/image.h>
 
+class jit_detector;
+
+/// A fixed size buffer, provided by the caller, in to which detected corners are
+/// written as offsets from the start of the image, in raster order. This allows 
+/// corners to be detected without allocating any memory. If there are more
+/// corners than will fit, then what happens depends on the overflow policy:
+/// - \c stop: Detection stops at the first corner which does not fit.
+/// - \c count: Detection continues to the end, and every corner is counted,
+///   but only the first ones are stored.
+///
+/// In either case, overflowed() tells whether any corners were left out. With
+/// \c stop, \c found counts at least one corner which did not fit, but not
+/// necessarily all of them.
+/// @ingroup gFastTree
+struct corner_buffer
+{
+	///What to do when the buffer is full.
+	enum overflow_policy
+	{
+		stop,  ///< Stop detecting corners.
+		count  ///< Keep detecting corners, and count them.
+	};
+
+	///@param buffer Memory to store the corners in.
+	///@param capacity Number of corners which fit in \c buffer.
+	///@param overflow What to do when the buffer is full.
+	corner_buffer(int* buffer, int capacity, overflow_policy overflow=stop)
+	:data(buffer), capacity(capacity), size(0), found(0), policy(overflow)
+	{}
+
+	int* data;             ///< The corners.
+	int  capacity;         ///< Number of corners which fit in \c data.
+	int  size;             ///< Number of corners in \c data.
+	int  found;            ///< Number of corners found, including those which did not fit.
+	overflow_policy policy;///< What to do when the buffer is full.
+
+	///Add a corner, if there is room for it.
+	///@param c Offset of the corner from the start of the image.
+	///@return Whether there was room.
+	bool push(int c)
+	{
+		found++;
+
+		if(size == capacity)
+			return false;
+
+		data[size++] = c;
+		return true;
+	}
+
+	///Were any corners found which did not fit?
+	bool overflowed() const
+	{
+		return found > size;
+	}
+
+	///Empty the buffer, ready for the next image.
+	void clear()
+	{
+		size = found = 0;
+	}
+};
+
+/// A region of an image in which to detect corners, stored as runs of pixels
+/// in each row. Detectors given a mask only examine the pixels in the runs, so
+/// the time taken depends on the area of the region, rather than the area of the
+/// image. The runs are in raster order, and do not overlap.
+/// @ingroup gFastTree
+struct run_mask
+{
+	///A run of pixels in a row.
+	struct run
+	{
+		int y;  ///< Row of the run.
+		int x0; ///< First pixel of the run.
+		int x1; ///< Pixel after the last pixel of the run.
+	};
+
+	std::vector<run> runs; ///< The runs, in raster order.
+
+	///Make an empty mask.
+	run_mask()
+	{}
+
+	run_mask(const CVD::SubImage<CVD::byte>& mask);
+
+	///Add a run to the end of the mask. The run must come after all the
+	///runs already in the mask, in raster order. Adjacent runs are merged.
+	///@param y Row of the run.
+	///@param x0 First pixel of the run.
+	///@param x1 Pixel after the last pixel of the run.
+	void add(int y, int x0, int x1)
+	{
+		if(x0 >= x1)
+			return;
+
+		if(!runs.empty() && runs.back().y == y && runs.back().x1 == x0)
+			runs.back().x1 = x1;
+		else
+		{
+			run r = {y, x0, x1};
+			runs.push_back(r);
+		}
+	}
+};
+
+/// Counts gathered by running a detector over some images, to find out how much work
+/// it does and where. The detector is applied in a number of forms (each orientation,
+/// with and without intensity inversion), one after the other, until one of them detects
+/// a corner, so the counts are kept for each form as well as for each node. The counts 
+/// accumulate over any number of images, and write() makes a report.
+/// @ingroup gFastTree
+struct detector_profile
+{
+	uint64_t pixels;                ///< Number of pixels examined.
+	std::vector<uint64_t> visits;   ///< Number of times each node of the detector was visited.
+	std::vector<uint64_t> reached;  ///< Number of pixels for which each form was tried.
+	std::vector<uint64_t> detected; ///< Number of pixels for which each form detected a corner.
+	std::vector<uint64_t> tests;    ///< Number of pixel tests made by each form.
+
+	detector_profile()
+	:pixels(0)
+	{}
+
+	void resize(int nodes, int forms);
+	void write(std::ostream& o, const std::string& detector) const;
+};
+
 /// This struct contains a byte code compiled version of the detector.
-/// 
+/// The bytecode does not depend on the size of the image: the row stride is
+/// given when the detector is run, so one compiled detector can be used on
+/// images of any width, and on CVD::SubImage views of them. The interpreter
+/// uses memory offsets precomputed for one row stride (see set_stride()), and
+/// the machine code takes the stride at runtime.
 ///
 /// @ingroup gFastTree
 struct block_bytecode
@@ -46,8 +181,9 @@ struct block_bytecode
 	/// @ingroup gFastTree
 	struct fast_detector_bit
 	{
-		int offset; ///< Memory offset from centre pixel to examine. This means that the fast 
-		            ///detector must be created for an image of a known width.
+		int16_t x; ///< x position of the pixel to examine, relative to the centre pixel.
+		int16_t y; ///< y position of the pixel to examine, relative to the centre pixel.
+		int offset; ///< Memory offset from centre pixel to examine, for the row stride given to set_stride().
 
 		//Root node is 0. If lt == 0, then this is a leaf.
 		//gt holds the class.
@@ -61,9 +197,27 @@ struct block_bytecode
 
 	
 	std::vector<fast_detector_bit> d; ///<This contains the compiled bytecode.
+	std::vector<int> roots; ///<Position in \c d of the first block of each orientation of the tree. The last
+	                        ///element is the final non-corner block, which follows the last orientation.
+	std::shared_ptr<const jit_detector> jit; ///<Machine code compiled from \c d. This is null unless compile() has succeeded.
+	int stride; ///<Row stride for which fast_detector_bit::offset has been computed, or 0 if it has not been.
+
+	block_bytecode()
+	:stride(0)
+	{}
+
+	///Memory offset of the pixel examined by a block, for any row stride.
+	///@param n  Block
+	///@param stride Row stride of the image
+	///@return Offset from the centre pixel
+	inline int offset(int n, int stride) const
+	{
+		return d[n].x + d[n].y * stride;
+	}
 
 	///Detects a corner at a given pointer, without the book keeping required to compute the score.
-	///This is quite a lot faster than @ref detect.
+	///This is quite a lot faster than @ref detect. The image must have the row stride given to
+	///set_stride().
 	///
 	///@param imp  Pointer at which to detect corner
 	///@param b	   FAST barrier
@@ -90,7 +244,8 @@ struct block_bytecode
 		return d[n].gt;
 	}
 
-	///Detects a corner at a given pointer, with book-keeping required for score computation
+	///Detects a corner at a given pointer, with book-keeping required for score computation.
+	///The image must have the row stride given to set_stride().
 	///
 	///@param imp  Pointer at which to detect corner
 	///@param b	   FAST barrier
@@ -155,27 +310,31 @@ struct block_bytecode
 	///endif
 	///@endcode
 	///@param o 		ostream for output
-	///@param width 	width the detector was created at, required to back out the offsets correctly.
-	void print(std::ostream& o, int width) const
+	void print(std::ostream& o) const
 	{
 		for(unsigned int i=0; i < d.size(); i++)
 		{
 			if(d[i].lt == 0)
 				o << "Block " << i <<" " <<  (d[i].gt?"corner":"non_corner") << std::endl;
 			else
-			{
-				int a = abs(d[i].offset) + width / 2;
-				if(d[i].offset < 0)
-					a = -a;
-				int y = a / width;
-
-				int x = d[i].offset - y * width;
-				o << "Bloc k" << i << " " << CVD::ImageRef(x , y) << " " << d[i].gt << " " << d[i].eq << " " << d[i].lt << std::endl;
-			}
+				o << "Bloc k" << i << " " << CVD::ImageRef(d[i].x, d[i].y) << " " << d[i].gt << " " << d[i].eq << " " << d[i].lt << std::endl;
 		}
 	}
 
-	void detect(const CVD::Image<CVD::byte>& im, std::vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax);
+	void compile();
+	void set_stride(int s);
+	int minimise();
+	void detect(const CVD::SubImage<CVD::byte>& im, std::vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const;
+	bool detect(const CVD::SubImage<CVD::byte>& im, corner_buffer& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const;
+	void detect(const CVD::SubImage<CVD::byte>& im, std::vector<int>& corners, int threshold, const run_mask& mask, int xmin, int xmax, int ymin, int ymax) const;
+	void score(const CVD::byte* base, int stride, const std::vector<int>& corners, int threshold, std::vector<int>& scores) const;
+	void profile(const CVD::SubImage<CVD::byte>& im, int threshold, int xmin, int xmax, int ymin, int ymax, std::vector<unsigned int>& visits) const;
+	void profile(const CVD::SubImage<CVD::byte>& im, int threshold, int xmin, int xmax, int ymin, int ymax, detector_profile& p) const;
+
+	static bool jit_available();
+
+	private:
+		const block_bytecode& with_stride(int s, block_bytecode& copy) const;
 };
 
 #endif
@@ -0,0 +1,406 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "faster_circuit.h"
+#include "faster_tree.h"
+
+#include <algorithm>
+
+#if defined(LANES_AVX2)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+///\cond never
+using namespace std;
+using namespace CVD;
+///\endcond
+
+const int bitslice_circuit::block_size;
+
+///Number of 64 bit words in each bit mask.
+static const int words = bitslice_circuit::block_size / 64;
+
+///Compile a tree in to a circuit. The output of the circuit is the OR of the tree in
+///every orientation, with and without intensity inversion. Identical gates are made
+///only once, constants are folded, and gates which do not contribute to the output are
+///removed.
+///@param tree The tree to compile.
+bitslice_circuit::bitslice_circuit(const tree_element& tree)
+:output(0),slots(0),values(2)
+{
+	//Value 0 is all zeros and value 1 is all ones.
+	for(int invert=0; invert < 2; invert++)
+		for(unsigned int n=0; n < offsets.size(); n++)
+			output = make_mux(compile(&tree, n, invert, true), 1, output);
+
+	allocate();
+}
+
+///Get the inputs for a pixel offset, making them if necessary.
+///@param offset The offset from the centre pixel
+///@return The value of the brighter input. The darker input is the next value.
+int bitslice_circuit::input(ImageRef offset)
+{
+	map<ImageRef, int>::iterator i = input_ids.find(offset);
+
+	if(i != input_ids.end())
+		return i->second;
+
+	input_ids[offset] = values;
+	values += 2;
+	return values - 2;
+}
+
+///Make a gate computing <code>(x & y) | (~x & z)</code>, unless the result is a
+///constant or an existing value, or the same gate has already been made.
+///@param x The selector
+///@param y Value to select where \c x is set.
+///@param z Value to select where \c x is not set.
+///@return The value of the result.
+int bitslice_circuit::make_mux(int x, int y, int z)
+{
+	//Where x is set, y is known to be set if it is x, and similarly for z.
+	if(y == x)
+		y = 1;
+	if(z == x)
+		z = 0;
+
+	if(x < 2)
+		return x ? y : z;
+	else if(y == z)
+		return y;
+	else if(y == 1 && z == 0)
+		return x;
+
+	tuple<int, int, int> k(x, y, z);
+	map<tuple<int, int, int>, int>::iterator i = made.find(k);
+	if(i != made.end())
+		return i->second;
+
+	gate g = {x, y, z, values};
+	gates.push_back(g);
+	made[k] = values;
+	return values++;
+}
+
+///Compile a tree in a single orientation and form. This follows the same
+///structure as tree_element::make_fast_detector_o().
+///@param t The tree
+///@param n Orientation of the tree (index in to ::offsets)
+///@param invert Whether to perform an intensity inversion
+///@param eq_branch Whether \c t is on an \c eq branch, or is the whole tree. A leaf
+///                 here is a non-corner, whatever its class.
+///@return The value which is set for corners.
+int bitslice_circuit::compile(const tree_element* t, int n, bool invert, bool eq_branch)
+{
+	if(t->is_leaf())
+		return !eq_branch && t->is_corner;
+
+	int brighter = input(offsets[n][t->offset_index]);
+	int darker = brighter + 1;
+
+	const tree_element* llt = t->lt;
+	const tree_element* lgt = t->gt;
+
+	if(invert)
+		swap(llt, lgt);
+
+	int g = compile(lgt, n, invert, false);
+	int l = compile(llt, n, invert, false);
+	int e = compile(t->eq, n, invert, true);
+
+	//A pixel can not be both brighter and darker, so the order of the tests
+	//does not matter.
+	return make_mux(brighter, g, make_mux(darker, l, e));
+}
+
+///Remove unused gates and inputs, and assign each value a slot. Values which
+///are no longer needed have their slots reused, so that the working set of the
+///circuit is small.
+void bitslice_circuit::allocate()
+{
+	//Find the values which contribute to the output.
+	vector<bool> needed(values);
+	needed[output] = 1;
+	for(int i=gates.size()-1; i >= 0; i--)
+		if(needed[gates[i].out])
+			needed[gates[i].x] = needed[gates[i].y] = needed[gates[i].z] = 1;
+
+	//Slots 0 and 1 hold the constants, and are followed by the inputs.
+	vector<int> slot(values, -1);
+	slot[0] = 0;
+	slot[1] = 1;
+
+	vector<ImageRef> used;
+	for(map<ImageRef, int>::iterator i=input_ids.begin(); i != input_ids.end(); i++)
+		if(needed[i->second] || needed[i->second+1])
+		{
+			slot[i->second] = 2 + 2 * used.size();
+			slot[i->second + 1] = 3 + 2 * used.size();
+			used.push_back(i->first);
+		}
+
+	vector<gate> live;
+	for(unsigned int i=0; i < gates.size(); i++)
+		if(needed[gates[i].out])
+			live.push_back(gates[i]);
+
+	vector<int> last_use(values, -1);
+	for(unsigned int i=0; i < live.size(); i++)
+		last_use[live[i].x] = last_use[live[i].y] = last_use[live[i].z] = i;
+	last_use[output] = live.size();
+
+	//Allocate gate outputs
+	int first = 2 + 2 * used.size();
+	int next = first;
+	vector<int> free_slots;
+
+	for(unsigned int i=0; i < live.size(); i++)
+	{
+		gate& g = live[i];
+
+		int in[3] = {g.x, g.y, g.z};
+		for(int j=0; j < 3; j++)
+			if(last_use[in[j]] == (int)i && slot[in[j]] >= first && find(in, in + j, in[j]) == in + j)
+				free_slots.push_back(slot[in[j]]);
+
+		g.x = slot[g.x];
+		g.y = slot[g.y];
+		g.z = slot[g.z];
+
+		if(free_slots.empty())
+			slot[g.out] = next++;
+		else
+		{
+			slot[g.out] = free_slots.back();
+			free_slots.pop_back();
+		}
+
+		g.out = slot[g.out];
+	}
+
+	output = slot[output];
+	slots = next;
+	inputs.swap(used);
+	gates.swap(live);
+
+	made.clear();
+	input_ids.clear();
+}
+
+///Evaluate gates on bit masks.
+///@param g First gate
+///@param end One past the last gate
+///@param v The bit masks
+template<class Gate> void run_gates(const Gate* g, const Gate* end, uint64_t* v)
+{
+	for(; g != end; g++)
+	{
+		const uint64_t* x = v + g->x * words;
+		const uint64_t* y = v + g->y * words;
+		const uint64_t* z = v + g->z * words;
+		uint64_t* o = v + g->out * words;
+
+		//The output may be in the same slot as an input.
+		#ifdef __SSE2__
+			__m128i r[words/2];
+			for(int w=0; w < words/2; w++)
+			{
+				__m128i s = _mm_load_si128((const __m128i*)x + w);
+				r[w] = _mm_or_si128(_mm_and_si128(s, _mm_load_si128((const __m128i*)y + w)), _mm_andnot_si128(s, _mm_load_si128((const __m128i*)z + w)));
+			}
+			for(int w=0; w < words/2; w++)
+				_mm_store_si128((__m128i*)o + w, r[w]);
+		#else
+			uint64_t r[words];
+			for(int w=0; w < words; w++)
+				r[w] = (x[w] & y[w]) | (~x[w] & z[w]);
+			for(int w=0; w < words; w++)
+				o[w] = r[w];
+		#endif
+	}
+}
+
+#ifdef LANES_AVX2
+	///Evaluate gates on bit masks, using AVX2 instructions.
+	///@param g First gate
+	///@param end One past the last gate
+	///@param v The bit masks
+	template<class Gate> __attribute__((target("avx2"))) void run_gates_avx2(const Gate* g, const Gate* end, uint64_t* v)
+	{
+		for(; g != end; g++)
+		{
+			const __m256i* x = (const __m256i*)(v + g->x * words);
+			const __m256i* y = (const __m256i*)(v + g->y * words);
+			const __m256i* z = (const __m256i*)(v + g->z * words);
+			__m256i* o = (__m256i*)(v + g->out * words);
+			__m256i r[words/4];
+
+			for(int w=0; w < words/4; w++)
+			{
+				__m256i s = _mm256_load_si256(x + w);
+				r[w] = _mm256_or_si256(_mm256_and_si256(s, _mm256_load_si256(y + w)), _mm256_andnot_si256(s, _mm256_load_si256(z + w)));
+			}
+			for(int w=0; w < words/4; w++)
+				_mm256_store_si256(o + w, r[w]);
+		}
+	}
+#endif
+
+///Evaluate the circuit.
+///@param v The bit masks, with the inputs filled in.
+void bitslice_circuit::run(uint64_t* v) const
+{
+	fill(v, v + words, 0);
+	fill(v + words, v + 2*words, ~0ull);
+
+	if(gates.empty())
+		return;
+
+	#ifdef LANES_AVX2
+		static const bool avx2 = __builtin_cpu_supports("avx2");
+		if(avx2)
+		{
+			run_gates_avx2(&gates[0], &gates[0] + gates.size(), v);
+			return;
+		}
+	#endif
+
+	run_gates(&gates[0], &gates[0] + gates.size(), v);
+}
+
+///Compute the brighter and darker masks for a block of pixels.
+///@param p The first pixel of the block
+///@param n Number of pixels in the block
+///@param offs Memory offs of the inputs
+///@param threshold The detector threshold
+///@param v The masks are stored here, starting with the brighter mask of the first offset.
+static void input_masks(const byte* p, int n, const vector<int>& offs, int threshold, uint64_t* v)
+{
+	#ifdef __SSE2__
+		if(n == bitslice_circuit::block_size)
+		{
+			//Saturating arithmetic gives the right answer: if the centre plus the threshold
+			//is more than 255, then no pixel is brighter. Similarly for darker.
+			alignas(16) byte cb[bitslice_circuit::block_size], c_b[bitslice_circuit::block_size];
+			__m128i t = _mm_set1_epi8((char)min(threshold, 255));
+			__m128i zero = _mm_setzero_si128();
+
+			for(int j=0; j < n; j+=16)
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(p + j));
+				_mm_store_si128((__m128i*)(cb + j), _mm_adds_epu8(c, t));
+				_mm_store_si128((__m128i*)(c_b + j), _mm_subs_epu8(c, t));
+			}
+
+			for(unsigned int i=0; i < offs.size(); i++, v += 2*words)
+			{
+				const byte* q = p + offs[i];
+
+				for(int w=0; w < words; w++)
+				{
+					uint64_t brighter=0, darker=0;
+
+					for(int k=0; k < 64; k+=16)
+					{
+						int j = w*64 + k;
+						__m128i x = _mm_loadu_si128((const __m128i*)(q + j));
+						uint64_t b = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(x, _mm_load_si128((const __m128i*)(cb + j))), zero));
+						uint64_t d = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(_mm_load_si128((const __m128i*)(c_b + j)), x), zero));
+						brighter |= (~b & 0xffff) << k;
+						darker |= (~d & 0xffff) << k;
+					}
+
+					v[w] = brighter;
+					v[w + words] = darker;
+				}
+			}
+			return;
+		}
+	#endif
+
+	for(unsigned int i=0; i < offs.size(); i++, v += 2*words)
+	{
+		fill(v, v + 2 * words, 0);
+
+		for(int j=0; j < n; j++)
+		{
+			int x = p[j + offs[i]];
+			v[j/64] |= (uint64_t)(x > p[j] + threshold) << (j%64);
+			v[j/64 + words] |= (uint64_t)(x < p[j] - threshold) << (j%64);
+		}
+	}
+}
+
+///Detect corners in an image by running the circuit over blocks of pixels. The pixels
+///are processed as one contiguous run of memory, from the first pixel of the region to the
+///last, and the corners found outside the region in between are discarded. The results
+///are identical to block_bytecode::detect(). The circuit does not depend on the row stride,
+///so it can be used on images of any width.
+///@param im The image in which to detect corners
+///@param corners Detected corners are inserted in to this container, as offsets from 
+///               <code>im.data()</code>. Rows are <code>im.row_stride()</code> apart.
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+void bitslice_circuit::detect(const SubImage<byte>& im, vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const
+{
+	if(xmax <= xmin || ymax <= ymin)
+		return;
+
+	int stride = im.row_stride();
+	int begin = ymin * stride + xmin;
+	int end = (ymax - 1) * stride + xmax;
+
+	vector<int> offs(inputs.size());
+	for(unsigned int i=0; i < inputs.size(); i++)
+		offs[i] = inputs[i].x + inputs[i].y * stride;
+
+	//The bit masks are aligned for SIMD instructions.
+	vector<uint64_t> storage(slots * words + 4);
+	uint64_t* v = &storage[0] + (4 - (reinterpret_cast<uintptr_t>(&storage[0]) / 8) % 4) % 4;
+	const uint64_t* result = v + output * words;
+
+	for(int b=begin; b < end; b += block_size)
+	{
+		int n = min(block_size, end - b);
+		input_masks(im.data() + b, n, offs, threshold, v + 2*words);
+		run(v);
+
+		for(int w=0; w < words && w * 64 < n; w++)
+		{
+			uint64_t m = result[w];
+			if(n - w*64 < 64)
+				m &= (1ull << (n - w*64)) - 1;
+
+			for(; m; m &= m-1)
+			{
+				int pos = b + w*64 + __builtin_ctzll(m);
+				int x = pos % stride;
+
+				if(x >= xmin && x < xmax)
+					corners.push_back(pos);
+			}
+		}
+	}
+}
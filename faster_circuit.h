@@ -0,0 +1,100 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_FASTER_CIRCUIT_H
+#define INC_FASTER_CIRCUIT_H
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <stdint.h>
+#include <cvd/image.h>
+#include <cvd/byte.h>
+
+class tree_element;
+
+///This class contains a bit-sliced version of the detector. The tree, in all orientations
+///and with intensity inversion, is compiled in to a boolean circuit with no branches. The
+///inputs of the circuit are the results of the pixel tests: whether the pixel at a given
+///offset is brighter than the centre plus the threshold, and whether it is darker than
+///the centre minus the threshold. Each value in the circuit is a bit mask, with one
+///bit per pixel, so the circuit is run over many pixels at once, and the running time
+///does not depend on the image.
+///
+///Every gate is a multiplexer, <code>(x & y) | (~x & z)</code>, which is the natural 
+///form of a branch in the tree. With constant inputs, this can also represent AND, OR
+///and NOT, so every gate is evaluated by the same branch-free code.
+///@ingroup gFastTree
+class bitslice_circuit
+{
+	public:
+		bitslice_circuit(const tree_element& tree);
+
+		void detect(const CVD::SubImage<CVD::byte>& im, std::vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const;
+
+		///Number of gates in the circuit.
+		int num_gates() const
+		{
+			return gates.size();
+		}
+
+		///Number of distinct pixel offsets examined by the circuit. There are two
+		///inputs (brighter and darker) per offset.
+		int num_offsets() const
+		{
+			return inputs.size();
+		}
+
+		///Number of bit mask slots needed to evaluate the circuit.
+		int num_slots() const
+		{
+			return slots;
+		}
+
+		///Number of pixels which the circuit processes at once.
+		static const int block_size = 512;
+
+	private:
+		///A gate in the circuit. The output is <code>(x & y) | (~x & z)</code>.
+		struct gate
+		{
+			int x;   ///< Selector
+			int y;   ///< Input selected where \c x is set
+			int z;   ///< Input selected where \c x is not set
+			int out; ///< Output
+		};
+
+		int make_mux(int x, int y, int z);
+		int compile(const tree_element* t, int n, bool invert, bool eq_branch);
+		int input(CVD::ImageRef offset);
+		void allocate();
+		void run(uint64_t* v) const;
+
+		std::vector<CVD::ImageRef> inputs; ///< Pixel offset of each pair of inputs.
+		std::vector<gate>          gates;  ///< The gates, in order of evaluation.
+		int                        output; ///< The value holding the corner mask.
+		int                        slots;  ///< Number of bit mask slots used by the gates.
+
+		//These are only used while the circuit is being built.
+		int                            values;    ///< Number of values (constants, inputs and gates) made so far.
+		std::map<CVD::ImageRef, int>   input_ids; ///< Value of the brighter input for each offset. The darker input follows it.
+		std::map<std::tuple<int, int, int>, int> made; ///< Gates made so far, to avoid making the same gate twice.
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "faster_compact.h"
+#include <algorithm>
+
+///\cond never
+using namespace std;
+using namespace CVD;
+///\endcond
+
+const uint16_t compact_bytecode::corner;
+const uint16_t compact_bytecode::non_corner;
+
+///Can a detector be converted to compact_bytecode? The number of blocks must fit in 16 bits,
+///leaving room for the special values, and so must the offsets.
+///@param b The detector
+///@param stride Row stride of the images the detector will be used on.
+///@return Whether the detector fits.
+bool compact_bytecode::fits(const block_bytecode& b, int stride)
+{
+	if(b.d.size() >= non_corner)
+		return false;
+
+	for(unsigned int i=0; i < b.d.size(); i++)
+		if(b.d[i].lt && (b.offset(i, stride) < INT16_MIN || b.offset(i, stride) > INT16_MAX))
+			return false;
+
+	return true;
+}
+
+///Convert a detector to the compact form. See fits() for the size limits.
+///
+///If visit counts are given, then the blocks are reordered by a depth first traversal in
+///which the most visited branch of each block is laid out first, so that the most common
+///paths through the detector run through consecutive blocks. Otherwise the order of
+///the blocks is kept.
+///@param b The detector
+///@param stride Row stride of the images the detector will be used on.
+///@param visits Number of times each block of \c b was visited, as computed by block_bytecode::profile()
+compact_bytecode::compact_bytecode(const block_bytecode& b, int stride, const vector<unsigned int>& visits)
+{
+	const vector<block_bytecode::fast_detector_bit>& f = b.d;
+
+	//Compute the new positions of the blocks. Leaves are removed.
+	vector<int> order;
+	vector<int> pos(f.size(), -1);
+
+	if(visits.size() == f.size())
+	{
+		vector<int> stack(1, 0);
+		while(!stack.empty())
+		{
+			int n = stack.back();
+			stack.pop_back();
+
+			if(pos[n] != -1 || f[n].lt == 0)
+				continue;
+
+			pos[n] = order.size();
+			order.push_back(n);
+
+			//Push the most visited branch last, so that it is placed next.
+			int branch[3] = {f[n].lt, f[n].gt, f[n].eq};
+			sort(branch, branch+3, [&](int i, int j){ return visits[i] < visits[j];});
+			stack.insert(stack.end(), branch, branch+3);
+		}
+	}
+
+	//Anything not reached (or everything, if there is no profile) is kept in order.
+	for(unsigned int i=0; i < f.size(); i++)
+		if(pos[i] == -1 && f[i].lt != 0)
+		{
+			pos[i] = order.size();
+			order.push_back(i);
+		}
+
+	d.resize(order.size());
+
+	for(unsigned int i=0; i < order.size(); i++)
+	{
+		const block_bytecode::fast_detector_bit& o = f[order[i]];
+		int branch[3] = {o.lt, o.gt, o.eq};
+		uint16_t target[3];
+
+		for(int j=0; j < 3; j++)
+			if(f[branch[j]].lt == 0)
+				target[j] = f[branch[j]].gt ? corner : non_corner;
+			else
+				target[j] = pos[branch[j]];
+
+		d[i].offset = b.offset(order[i], stride);
+		d[i].lt = target[0];
+		d[i].gt = target[1];
+		d[i].eq = target[2];
+	}
+}
+
+///Detect corners in an image. The row stride of the image must match the stride the
+///detector was compiled for.
+///@param im The image in which to detect corners
+///@param corners Detected corners are inserted in to this container.
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+void compact_bytecode::detect(const SubImage<byte>& im, vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const
+{
+	for(int y = ymin; y < ymax; y++)
+		for(int x=xmin; x < xmax; x++)
+			if(detect_no_score(&im[y][x], threshold))
+				corners.push_back(&im[y][x] - im.data());
+}
+
+///Compute the scores of a list of corners. The scores are identical to
+///block_bytecode::score().
+///@param base Pointer to the first pixel of the image.
+///@param corners Corners, as offsets from \c base.
+///@param threshold The threshold at which the corners were detected.
+///@param scores The scores are stored here, one for each corner.
+void compact_bytecode::score(const byte* base, const vector<int>& corners, int threshold, vector<int>& scores) const
+{
+	scores.resize(corners.size());
+
+	for(unsigned int j=0; j < corners.size(); j++)
+	{
+		int i=threshold + 1;
+		while(1)
+		{
+			int n = detect(base + corners[j], i);
+			if(n != 0)
+				i += n;
+			else
+				break;
+		}
+		scores[j] = i-1;
+	}
+}
@@ -0,0 +1,134 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_FASTER_COMPACT_H
+#define INC_FASTER_COMPACT_H
+
+#include <vector>
+#include <climits>
+#include <stdint.h>
+#include <cvd/byte.h>
+#include <cvd/image.h>
+
+#include "faster_bytecode.h"
+
+/// This struct contains a compact version of the bytecode, for large trees
+/// where the cache footprint of block_bytecode matters. Each block is 8 bytes instead
+/// of 16, and there are no leaf blocks: branches to a leaf are replaced with a special
+/// value giving the result. The blocks may also be reordered, so that the most
+/// frequently taken path through the detector is stored contiguously. Unlike
+/// block_bytecode, the offsets are computed for a particular row stride.
+///
+/// @ingroup gFastTree
+struct compact_bytecode
+{
+	/// This is a bytecode element for the compact detector. If a branch is
+	/// ::corner or ::non_corner, then the detector stops with that result,
+	/// otherwise the branch is the position of the next block. The root node
+	/// is the first block.
+	/// @ingroup gFastTree
+	struct compact_bit
+	{
+		int16_t  offset; ///< Memory offset from the centre pixel to examine.
+		uint16_t lt;     ///< Branch to take if the pixel is much darker than the centre.
+		uint16_t gt;     ///< Branch to take if the pixel is much brighter than the centre.
+		uint16_t eq;     ///< Branch to take otherwise.
+	};
+
+	static const uint16_t corner = 0xffff;     ///< Branch value for a corner.
+	static const uint16_t non_corner = 0xfffe; ///< Branch value for a non-corner.
+
+	std::vector<compact_bit> d; ///<This contains the compiled bytecode.
+
+	compact_bytecode(const block_bytecode& b, int stride, const std::vector<unsigned int>& visits = std::vector<unsigned int>());
+	static bool fits(const block_bytecode& b, int stride);
+
+	///Detects a corner at a given pointer, without the book keeping required to compute the score.
+	///
+	///@param imp  Pointer at which to detect corner
+	///@param b	   FAST barrier
+	///@return 	   is a corner or not
+	inline bool detect_no_score(const CVD::byte* imp, int b) const
+	{
+		unsigned int n=0;
+		int cb = *imp + b;
+		int c_b = *imp - b;
+
+		while(n < non_corner)
+		{
+			const compact_bit& c = d[n];
+			int p = imp[c.offset];
+
+			if(p > cb)
+				n = c.gt;
+			else if(p < c_b)
+				n = c.lt;
+			else
+				n = c.eq;
+		}
+
+		return n == corner;
+	}
+
+	///Detects a corner at a given pointer, with book-keeping required for score computation
+	///
+	///@param imp  Pointer at which to detect corner
+	///@param b	   FAST barrier
+	///@return 	   0 for non-corner, minimum increment required to make detector go down different branch, if it is a corner.
+	inline int detect(const CVD::byte* imp, int b) const
+	{
+		unsigned int n=0;
+		int m = INT_MAX;
+		int cb = *imp + b;
+		int c_b = *imp - b;
+
+		while(n < non_corner)
+		{
+			const compact_bit& c = d[n];
+			int p = imp[c.offset];
+
+			if(p > cb)
+			{
+				if(p-cb < m)
+					m = p-cb;
+
+				n = c.gt;
+			}
+			else if(p < c_b)
+			{
+				if(c_b - p < m)
+					m = c_b - p;
+
+				n = c.lt;
+			}
+			else
+				n = c.eq;
+		}
+
+		if(n == corner)
+			return m;
+		else
+			return 0;
+	}
+
+	void detect(const CVD::SubImage<CVD::byte>& im, std::vector<int>& corners, int threshold, int xmin, int xmax, int ymin, int ymax) const;
+	void score(const CVD::byte* base, const std::vector<int>& corners, int threshold, std::vector<int>& scores) const;
+};
+
+#endif
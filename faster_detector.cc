@@ -38,6 +38,8 @@
 #include "faster_detector.h"
 #include "faster_tree.h"
 #include "faster_bytecode.h"
+#include "flat_tree.h"
+#include "tree_file.h"
 
 #include <gvars3/instances.h>
 
@@ -77,13 +79,14 @@ faster_learn::faster_learn(const std::string& fname)
 	}
 	
 	try{
-		tree.reset(load_a_tree(i));
+		file_tree.reset(new flat_tree(load_tree_file(fname)));
 	}
 	catch(ParseError p)
 	{
 		cerr << "Parse error in " << fname << endl;
 		exit(1);
 	}
+	tree = file_tree->tree();
 
 	if(GV3::get<bool>("faster_tree.print_tree", 0, 1))
 	{
@@ -93,15 +96,14 @@ faster_learn::faster_learn(const std::string& fname)
 
 	if(GV3::get<bool>("faster_tree.print_block", 0, 1))
 	{
-		block_bytecode f2 = tree->make_fast_detector(100);
-		f2.print(clog,  100);
+		block_bytecode f2 = tree->make_fast_detector();
+		f2.print(clog);
 	}
 }
 
 
 void faster_learn::operator()(const CVD::Image<CVD::byte>& i, std::vector<CVD::ImageRef>& v, unsigned int t) const
 {
-	Image<int> scratch(i.size(), 0);
-
-	v = tree_detect_corners(i, tree.get(), t, scratch);
+	vector<int> scores;
+	tree_detect_corners_stream(i, tree, t, v, scores);
 }
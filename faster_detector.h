@@ -30,6 +30,7 @@
 #include "detectors.h"
 
 struct tree_element;
+class flat_tree;
 
 ///FAST-ER detector
 ///@ingroup gDetect
@@ -47,7 +48,9 @@ struct faster_learn: public DetectT
 
 	private:
 		///Loaded FAST-ER tree
-		std::unique_ptr<tree_element> tree;
+		std::unique_ptr<flat_tree> file_tree;
+		///View of the tree made by flat_tree::tree(), which the detectors are run on
+		const tree_element* tree;
 };
 
 #endif
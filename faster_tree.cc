@@ -18,9 +18,17 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include <memory>
+#include <mutex>
+#include <algorithm>
+#include <stdint.h>
+#include <iterator>
 #include <gvars3/instances.h>
  
 #include "faster_tree.h"
+#include "detector_cache.h"
+#include "thread_pool.h"
+#include "flat_tree.h"
+#include "tree_file.h"
 
 ///\cond never
 using namespace std;
@@ -28,19 +36,123 @@ using namespace CVD;
 using namespace GVars3;
 ///\endcond
 
+///Get the threads used for detection. The number of threads is given by the 
+///\c faster_tree.threads GVar, where 0 means one per hardware thread. The pool
+///is remade if the GVar changes.
+///@return The thread pool.
+static shared_ptr<thread_pool> detection_pool()
+{
+	static mutex lock;
+	static shared_ptr<thread_pool> pool;
+
+	int threads = GV3::get<int>("faster_tree.threads", 1, 1);
+	if(threads <= 0)
+		threads = max(1u, thread::hardware_concurrency());
+
+	lock_guard<mutex> l(lock);
+	if(!pool || pool->size() != threads)
+		pool.reset(new thread_pool(threads));
+
+	return pool;
+}
+
+///Make a function which detects corners in a rectangle using a compiled version of the detector.
+///The detector is fetched from the ::detector_cache, and the implementation is chosen by the 
+///\c faster_tree.engine GVar, where an unknown engine is a fatal error. The compiled detectors
+///are fetched once, here, and they are safe to share between threads, so the function may be
+///called from several threads at once.
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param f2 The bytecode is always stored here, since it is used for scoring.
+///@return Function called as <code>region(x0, x1, y0, y1, corners)</code>, which appends the corners
+///        in columns \c x0 to \c x1 of rows \c y0 to \c y1 to \c corners, as offsets from the start 
+///        of the image.
+static function<void(int, int, int, int, vector<int>&)> region_detector(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, shared_ptr<const block_bytecode>& f2)
+{
+	string engine = GV3::get<string>("faster_tree.engine", "jit", 1);
+
+	if(engine != "jit" && engine != "bytecode" && engine != "circuit" && engine != "compact")
+	{
+		cerr << "Fatal error: unknown faster_tree.engine \"" << engine << "\".\n";
+		exit(1);
+	}
+
+	shared_ptr<const block_bytecode> b = detector_cache::instance().get(*detector, im.row_stride(), engine == "jit");
+	shared_ptr<const compact_bytecode> c;
+	f2 = b;
+
+	if(engine == "circuit")
+	{
+		shared_ptr<const bitslice_circuit> bc = detector_cache::instance().get_circuit(*detector);
+		return [=, &im](int x0, int x1, int y0, int y1, vector<int>& r){ bc->detect(im, r, threshold, x0, x1, y0, y1);};
+	}
+	else if(engine == "compact" && (c = detector_cache::instance().get_compact(*detector, im.row_stride())))
+		return [=, &im](int x0, int x1, int y0, int y1, vector<int>& r){ c->detect(im, r, threshold, x0, x1, y0, y1);};
+	
+	//The compact detector is not made for trees which are too large for it, in which
+	//case the bytecode is used.
+	return [=, &im](int x0, int x1, int y0, int y1, vector<int>& r){ b->detect(im, r, threshold, x0, x1, y0, y1);};
+}
+
+///Make a function which detects corners in a band of rows using a compiled version of the detector
+///(see region_detector()).
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param xmin x coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param f2 The bytecode is always stored here, since it is used for scoring.
+///@return Function called as <code>band(y0, y1, corners)</code>, which appends the corners in
+///        rows \c y0 to \c y1 to \c corners, as offsets from the start of the image.
+static function<void(int, int, vector<int>&)> band_detector(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, int xmin, int xmax, shared_ptr<const block_bytecode>& f2)
+{
+	function<void(int, int, int, int, vector<int>&)> region = region_detector(im, detector, threshold, f2);
+	return [=](int y0, int y1, vector<int>& r){ region(xmin, xmax, y0, y1, r);};
+}
+
+///Detect corners using a compiled version of the detector (see band_detector()).
+///The image is split in to bands of rows which are processed in parallel, and the corners
+///from each band are merged in order, so the result is the same as for a single thread.
+///The bytecode is always returned, since it is used for scoring.
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param xmin x coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymin y coordinate to start at.
+///@param ymax y coordinate to go up to.
+///@param pool The threads to use.
+///@param corners Detected corners are inserted in to this container, as offsets from the start of the image.
+///@return The compiled detector.
+static shared_ptr<const block_bytecode> compiled_detect(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, int xmin, int xmax, int ymin, int ymax, thread_pool& pool, vector<int>& corners)
+{
+	shared_ptr<const block_bytecode> f2;
+	ordered_for(pool, ymin, ymax, 16, corners, band_detector(im, detector, threshold, xmin, xmax, f2));
+	return f2;
+}
+
 ///Detect corners without nonmaximal suppression in an image. This contains a large amount of
 ///configurable debugging code to verify the correctness of the detector by comparing different
 ///implementations. High speed is achieved by converting the detector in to \link gFastTree bytecode
-///and JIT-compiling if possible\endlink.
+///and JIT-compiling if possible\endlink. Compiled detectors are kept in the ::detector_cache, so
+///the compilation happens once for a sequence of images. The image may be a view in to a larger
+///image, and the bytecode and machine code work for any row stride.
 ///
 ///The function recognises the following GVars:
 /// - \c debug.verify_detections Veryify JIT or bytecode detected corners using tree_element::detect_corner
+/// - \c faster_tree.engine      Detect corners using the JIT compiler (\c jit, default), the 
+///                              bit-sliced circuit (\c circuit), the compact bytecode interpreter
+///                              (\c compact) or the bytecode interpreter (\c bytecode)
+/// - \c faster_tree.threads     Number of threads to detect corners with (default 1). 0 means one
+///                              thread per hardware thread. The corners do not depend on the
+///                              number of threads.
 ///
 ///@param im The image to detect corners in.
 ///@param detector The corner detector.
 ///@param threshold The detector threshold.
 ///@ingroup gTree
-vector<ImageRef> tree_detect_corners_all(const Image<CVD::byte>& im, const tree_element* detector, int threshold)
+vector<ImageRef> tree_detect_corners_all(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold)
 {
 	ImageRef tl, br, s;
 	tie(tl,br) = detector->bbox();
@@ -53,9 +165,7 @@ vector<ImageRef> tree_detect_corners_all(const Image<CVD::byte>& im, const tree_
 	
 	vector<int> corners;
 	
-	block_bytecode f2 = detector->make_fast_detector(im.size().x);
-
-	f2.detect(im, corners, threshold, xmin, xmax, ymin, ymax);
+	shared_ptr<const block_bytecode> f2 = compiled_detect(im, detector, threshold, xmin, xmax, ymin, ymax, *detection_pool(), corners);
 	
 
 	if(GV3::get<bool>("debug.verify_detections"))
@@ -92,7 +202,7 @@ vector<ImageRef> tree_detect_corners_all(const Image<CVD::byte>& im, const tree_
 
 	vector<ImageRef> ret;
 
-	int d = im.size().x;
+	int d = im.row_stride();
 	for(unsigned int i=0; i < corners.size(); i++)
 	{
 		int o = corners[i];
@@ -107,11 +217,19 @@ vector<ImageRef> tree_detect_corners_all(const Image<CVD::byte>& im, const tree_
 ///Detect corners with nonmaximal suppression in an image. This contains a large amount of
 ///configurable debugging code to verify the correctness of the detector by comparing different
 ///implementations. High speed is achieved by converting the detector in to \link gFastTree bytecode
-///and JIT-compiling if possible\endlink.
+///and JIT-compiling if possible\endlink. Compiled detectors are kept in the ::detector_cache, so
+///the compilation happens once for a sequence of images. The image may be a view in to a larger
+///image, and the bytecode and machine code work for any row stride.
 ///
 ///The function recognises the following GVars:
 /// - \c debug.verify_detections Veryify JIT or bytecode detected corners using tree_element::detect_corner
 /// - \c debug.verify_scores     Veryify bytecode computed scores using tree_element::detect_corner
+/// - \c faster_tree.engine      Detect corners using the JIT compiler (\c jit, default), the 
+///                              bit-sliced circuit (\c circuit), the compact bytecode interpreter
+///                              (\c compact) or the bytecode interpreter (\c bytecode)
+/// - \c faster_tree.threads     Number of threads to detect corners with (default 1). 0 means one
+///                              thread per hardware thread. The corners do not depend on the
+///                              number of threads.
 ///
 ///@param im The image to detect corners in.
 ///@param detector The corner detector.
@@ -120,7 +238,7 @@ vector<ImageRef> tree_detect_corners_all(const Image<CVD::byte>& im, const tree_
 ///              the same size as im. It is passed as a parameter since allocation of an image of this
 ///              size is a significant expense.
 ///@ingroup gTree
-vector<ImageRef> tree_detect_corners(const Image<CVD::byte>& im, const tree_element* detector, int threshold, Image<int> scores)
+vector<ImageRef> tree_detect_corners(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, Image<int> scores)
 {
 	ImageRef tl, br, s;
 	tie(tl,br) = detector->bbox();
@@ -134,9 +252,8 @@ vector<ImageRef> tree_detect_corners(const Image<CVD::byte>& im, const tree_elem
 	
 	vector<int> corners;
 	
-	block_bytecode f2 = detector->make_fast_detector(im.size().x);
-
-	f2.detect(im, corners, threshold, xmin, xmax, ymin, ymax);
+	shared_ptr<thread_pool> pool = detection_pool();
+	shared_ptr<const block_bytecode> f2 = compiled_detect(im, detector, threshold, xmin, xmax, ymin, ymax, *pool, corners);
 	
 
 	if(GV3::get<bool>("debug.verify_detections"))
@@ -173,30 +290,33 @@ vector<ImageRef> tree_detect_corners(const Image<CVD::byte>& im, const tree_elem
 
 
 
-	//Compute scores
+	//Compute scores. The corners are independent, so they are split between the threads.
+	vector<int> corner_scores;
+	ordered_for(*pool, 0, corners.size(), 256, corner_scores, [&](int b, int e, vector<int>& r)
+	{
+		vector<int> c(corners.begin() + b, corners.begin() + e), cs;
+		f2->score(im.data(), im.row_stride(), c, threshold, cs);
+		r.insert(r.end(), cs.begin(), cs.end());
+	});
+
+	//From here on, corners are offsets in to the score image, which may have a different
+	//row stride to the image.
+	int d = scores.size().x;
 	for(unsigned int j=0; j < corners.size(); j++)
 	{
-		int i=threshold + 1;
-		while(1)
-		{
-			int n = f2.detect(im.data() + corners[j], i);
-			if(n != 0)
-				i += n;
-			else
-				break;
-		}
-		scores.data()[corners[j]] = i-1;
+		corners[j] = corners[j] / im.row_stride() * d + corners[j] % im.row_stride();
+		scores.data()[corners[j]] = corner_scores[j];
 	}
 
 	if(GV3::get<bool>("debug.verify_scores"))
 	{
 		//Compute scores using the obvious, but slow recursive implementation.
 		//This can be used to test the no obvious FAST implementation and the
-		//non obviouser JIT implementation, if it ever exists.
+		//non obviouser JIT implementation.
 		for(unsigned int j=0; j < corners.size(); j++)
 		{
 			int i=threshold + 1;
-			ImageRef pos =  im.pos(im.data() + corners[j]);
+			ImageRef pos(corners[j] % d, corners[j] / d);
 			while(1)
 			{
 				int n = detector->detect_corner(im, pos, i);
@@ -216,30 +336,373 @@ vector<ImageRef> tree_detect_corners(const Image<CVD::byte>& im, const tree_elem
 	}
 
 	
-	//Perform non-max suppression the simple way
+	//Perform non-max suppression the simple way. All the scores have been written by
+	//now, so the corners can be split between threads, even though the neighbours
+	//of a corner may belong to another thread.
 	vector<ImageRef> nonmax;
-	int d = im.size().x;
-	for(unsigned int i=0; i < corners.size(); i++)
+	ordered_for(*pool, 0, corners.size(), 1024, nonmax, [&](int b, int e, vector<ImageRef>& r)
 	{
-		int o = corners[i];
-		int v = scores.data()[o];
-
-		if( v > *(scores.data() + o + 1    )  &&
-		    v > *(scores.data() + o - 1    )  &&
-		    v > *(scores.data() + o +d + 1 )  &&
-		    v > *(scores.data() + o +d     )  &&
-		    v > *(scores.data() + o +d - 1 )  &&
-		    v > *(scores.data() + o -d + 1 )  &&
-		    v > *(scores.data() + o -d     )  &&
-		    v > *(scores.data() + o -d - 1))
+		for(int i=b; i < e; i++)
 		{
-			nonmax.push_back(ImageRef(o %d, o/d));
+			int o = corners[i];
+			int v = scores.data()[o];
+
+			if( v > *(scores.data() + o + 1    )  &&
+			    v > *(scores.data() + o - 1    )  &&
+			    v > *(scores.data() + o +d + 1 )  &&
+			    v > *(scores.data() + o +d     )  &&
+			    v > *(scores.data() + o +d - 1 )  &&
+			    v > *(scores.data() + o -d + 1 )  &&
+			    v > *(scores.data() + o -d     )  &&
+			    v > *(scores.data() + o -d - 1))
+			{
+				r.push_back(ImageRef(o %d, o/d));
+			}
 		}
-	}
+	});
 
 	return nonmax;
 }
 
+///Detect corners with nonmaximal suppression in an image, in a single pass from top to 
+///bottom (see tree_detect_corners_stream()).
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param mask If not null, only the pixels covered by this are examined.
+///@param corners The corners are returned here, in raster order.
+///@param scores The score of each corner is returned here.
+static void stream_detect(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, const run_mask* mask, vector<ImageRef>& corners, vector<int>& scores)
+{
+	ImageRef tl, br;
+	tie(tl,br) = detector->bbox();
+
+	int ymin = 1 - tl.y, ymax = im.size().y - 1 - br.y;
+	int xmin = 1 - tl.x, xmax = im.size().x - 1 - br.x;
+	int w = im.size().x, stride = im.row_stride();
+
+	corners.clear();
+	scores.clear();
+
+	if(ymin >= ymax || xmin >= xmax)
+		return;
+
+	shared_ptr<const block_bytecode> f2;
+	function<void(int, int, int, int, vector<int>&)> detect = region_detector(im, detector, threshold, f2);
+	
+	//The next run of the mask to detect corners in.
+	unsigned int run = 0;
+
+	//Scores of the last three rows, with 0 for no corner. Scores never exceed 254, since
+	//no pixel can be brighter than the centre by more than that.
+	vector<uint8_t> ring(3 * w, 0);
+
+	//Corners (as offsets from the start of the image) and their scores, for the current
+	//and previous rows.
+	vector<int> row[2], row_scores[2];
+
+	//One extra iteration with no detection suppresses the last row.
+	for(int y=ymin; y <= ymax; y++)
+	{
+		vector<int>& c = row[y&1];
+		vector<int>& cs = row_scores[y&1];
+		uint8_t* below = &ring[(y%3)*w];
+
+		c.clear();
+		cs.clear();
+		fill(below, below + w, 0);
+
+		if(y < ymax)
+		{
+			if(mask)
+				for(; run < mask->runs.size() && mask->runs[run].y <= y; run++)
+				{
+					const run_mask::run& r = mask->runs[run];
+					int x0 = max(r.x0, xmin), x1 = min(r.x1, xmax);
+
+					if(r.y == y && x0 < x1)
+						detect(x0, x1, y, y+1, c);
+				}
+			else
+				detect(xmin, xmax, y, y+1, c);
+
+			f2->score(im.data(), stride, c, threshold, cs);
+
+			for(unsigned int j=0; j < c.size(); j++)
+				below[c[j] - y * stride] = cs[j];
+		}
+
+		//Row y has been scored, so row y-1 can be suppressed.
+		const vector<int>& p = row[(y-1)&1];
+		const vector<int>& ps = row_scores[(y-1)&1];
+		const uint8_t* above = &ring[((y+1)%3)*w];
+		const uint8_t* mid = &ring[((y+2)%3)*w];
+
+		for(unsigned int j=0; j < p.size(); j++)
+		{
+			int x = p[j] - (y-1) * stride;
+			int v = ps[j];
+
+			if( v > mid[x + 1]   &&
+			    v > mid[x - 1]   &&
+			    v > below[x + 1] &&
+			    v > below[x]     &&
+			    v > below[x - 1] &&
+			    v > above[x + 1] &&
+			    v > above[x]     &&
+			    v > above[x - 1])
+			{
+				corners.push_back(ImageRef(x, y-1));
+				scores.push_back(v);
+			}
+		}
+	}
+}
+
+///Detect corners with nonmaximal suppression in an image, in a single pass from top to 
+///bottom. Each row is detected and scored in turn, and the scores are kept in a ring of
+///three rows, so a row is suppressed as soon as the row below it has been scored. Unlike
+///tree_detect_corners(), no image sized scratch space is needed, and the image is only 
+///read once. The corners and their scores are the same as those of tree_detect_corners().
+///
+///The function recognises the \c faster_tree.engine GVar (see tree_detect_corners()). It
+///runs on a single thread, so several images may be processed at once on different threads.
+///
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param corners The corners are returned here, in raster order.
+///@param scores The score of each corner is returned here.
+///@ingroup gTree
+void tree_detect_corners_stream(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, vector<ImageRef>& corners, vector<int>& scores)
+{
+	stream_detect(im, detector, threshold, 0, corners, scores);
+}
+
+///Detect corners with nonmaximal suppression in the parts of an image covered by a mask.
+///Only the pixels in the mask are examined, so the time taken depends on the area of the
+///mask rather than the area of the image. Pixels outside the mask are treated as if they
+///were not corners, so a corner next to the edge of the mask is not suppressed by a 
+///stronger corner just outside it. With a mask covering the whole image, the result is
+///the same as tree_detect_corners_stream().
+///
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param mask The pixels of \c im in which to detect corners.
+///@param corners The corners are returned here, in raster order.
+///@param scores The score of each corner is returned here.
+///@ingroup gTree
+void tree_detect_corners_masked(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, const run_mask& mask, vector<ImageRef>& corners, vector<int>& scores)
+{
+	stream_detect(im, detector, threshold, &mask, corners, scores);
+}
+
+///Detect, score and suppress the corners in one tile of an image. Corners are detected in
+///the tile and a border of one pixel around it (clipped to the region where corners can be
+///detected), which is all that is needed to suppress the corners in the tile.
+///@param im The image to detect corners in.
+///@param detect Detector for rectangles of \c im, from region_detector().
+///@param f2 Bytecode used for scoring.
+///@param threshold The detector threshold.
+///@param x0 First column of the tile.
+///@param x1 Column after the tile.
+///@param y0 First row of the tile.
+///@param y1 Row after the tile.
+///@param xmin x coordinate where detection can start.
+///@param xmax x coordinate where detection must stop.
+///@param ymin y coordinate where detection can start.
+///@param ymax y coordinate where detection must stop.
+///@param corners The corners in the tile are appended here, in raster order.
+///@param scores The score of each corner is appended here.
+static void detect_tile(const SubImage<CVD::byte>& im, const function<void(int, int, int, int, vector<int>&)>& detect, const block_bytecode& f2, int threshold, int x0, int x1, int y0, int y1, int xmin, int xmax, int ymin, int ymax, vector<ImageRef>& corners, vector<int>& scores)
+{
+	x0 = max(x0, xmin);
+	x1 = min(x1, xmax);
+	y0 = max(y0, ymin);
+	y1 = min(y1, ymax);
+
+	if(x0 >= x1 || y0 >= y1)
+		return;
+
+	vector<int> c, cs;
+	detect(max(x0-1, xmin), min(x1+1, xmax), max(y0-1, ymin), min(y1+1, ymax), c);
+
+	f2.score(im.data(), im.row_stride(), c, threshold, cs);
+
+	//Scores of the tile and its border, with 0 for no corner. Scores never exceed 254, since
+	//no pixel can be brighter than the centre by more than that.
+	int w = x1 - x0 + 2;
+	vector<uint8_t> s(w * (y1 - y0 + 2), 0);
+	for(unsigned int j=0; j < c.size(); j++)
+		s[(c[j] / im.row_stride() - y0 + 1) * w + c[j] % im.row_stride() - x0 + 1] = cs[j];
+
+	for(unsigned int j=0; j < c.size(); j++)
+	{
+		int x = c[j] % im.row_stride(), y = c[j] / im.row_stride();
+		
+		if(x < x0 || x >= x1 || y < y0 || y >= y1)
+			continue;
+
+		const uint8_t* p = &s[(y - y0 + 1) * w + x - x0 + 1];
+		int v = cs[j];
+
+		if( v > p[1]     &&
+		    v > p[-1]    &&
+		    v > p[w+1]   &&
+		    v > p[w]     &&
+		    v > p[w-1]   &&
+		    v > p[-w+1]  &&
+		    v > p[-w]    &&
+		    v > p[-w-1])
+		{
+			corners.push_back(ImageRef(x, y));
+			scores.push_back(v);
+		}
+	}
+}
+
+///Detect corners with nonmaximal suppression in a rectangular tile of an image. The corners
+///and their scores are exactly those of tree_detect_corners() on the whole of \c im which lie
+///in the tile, so an image can be processed as a set of tiles, for instance if it does not fit
+///in memory or in cache. The result depends only on the pixels within the tile and a halo
+///around it (see tree_detect_halo()), so \c im need only contain the tile and its halo.
+///
+///The function recognises the \c faster_tree.engine GVar (see tree_detect_corners()).
+///
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param pos Top left corner of the tile.
+///@param size Size of the tile.
+///@param corners The corners in the tile are appended here, in raster order.
+///@param scores The score of each corner is appended here.
+///@ingroup gTree
+void tree_detect_corners_tile(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, ImageRef pos, ImageRef size, vector<ImageRef>& corners, vector<int>& scores)
+{
+	ImageRef tl, br;
+	tie(tl,br) = detector->bbox();
+
+	int ymin = 1 - tl.y, ymax = im.size().y - 1 - br.y;
+	int xmin = 1 - tl.x, xmax = im.size().x - 1 - br.x;
+
+	shared_ptr<const block_bytecode> f2;
+	function<void(int, int, int, int, vector<int>&)> detect = region_detector(im, detector, threshold, f2);
+
+	detect_tile(im, detect, *f2, threshold, pos.x, pos.x + size.x, pos.y, pos.y + size.y, xmin, xmax, ymin, ymax, corners, scores);
+}
+
+///Find how far outside a tile tree_detect_corners_tile() reads the image. A corner depends on
+///the pixels examined by the detector at the corner and at its neighbours, and on whether its
+///neighbours are far enough from the edge of the image to be detected.
+///@param detector The corner detector.
+///@return The number of pixels needed to the left of and above the tile (first) and to the right
+///        of and below the tile (second).
+///@ingroup gTree
+pair<ImageRef, ImageRef> tree_detect_halo(const tree_element* detector)
+{
+	ImageRef tl, br;
+	tie(tl,br) = detector->bbox();
+
+	return make_pair(ImageRef(2,2) - tl, ImageRef(2,2) + br);
+}
+
+///Detect corners with nonmaximal suppression in an image, one tile at a time. Each tile is
+///small enough that the rows of the image it reads stay in cache while it is processed, which
+///matters for very wide images, where a few whole rows do not fit in cache. The tiles are
+///independent, so they are processed in parallel. The corners and their scores are the same as
+///those of tree_detect_corners(), in raster order.
+///
+///The function recognises the following GVars, as well as \c faster_tree.engine and
+///\c faster_tree.threads (see tree_detect_corners()):
+/// - \c faster_tree.tile_width  Width of the tiles (default 256)
+/// - \c faster_tree.tile_height Height of the tiles (default 64)
+///
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param corners The corners are returned here, in raster order.
+///@param scores The score of each corner is returned here.
+///@ingroup gTree
+void tree_detect_corners_tiled(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, vector<ImageRef>& corners, vector<int>& scores)
+{
+	tree_detect_corners_tiled(im, detector, threshold, ImageRef(0,0), im.size(), corners, scores);
+}
+
+///Detect corners with nonmaximal suppression in a rectangle of an image, one tile at a time
+///(see tree_detect_corners_tiled()). As with tree_detect_corners_tile(), the corners are those
+///of tree_detect_corners() on the whole of \c im which lie in the rectangle.
+///@param im The image to detect corners in.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param pos Top left corner of the rectangle.
+///@param size Size of the rectangle.
+///@param corners The corners are returned here, in raster order.
+///@param scores The score of each corner is returned here.
+///@ingroup gTree
+void tree_detect_corners_tiled(const SubImage<CVD::byte>& im, const tree_element* detector, int threshold, ImageRef pos, ImageRef size, vector<ImageRef>& corners, vector<int>& scores)
+{
+	ImageRef tl, br;
+	tie(tl,br) = detector->bbox();
+
+	int ymin = 1 - tl.y, ymax = im.size().y - 1 - br.y;
+	int xmin = 1 - tl.x, xmax = im.size().x - 1 - br.x;
+
+	//Only the part of the rectangle where corners can be detected is split in to tiles.
+	int x0 = max(pos.x, xmin), x1 = min(pos.x + size.x, xmax);
+	int y0 = max(pos.y, ymin), y1 = min(pos.y + size.y, ymax);
+
+	corners.clear();
+	scores.clear();
+
+	if(y0 >= y1 || x0 >= x1)
+		return;
+
+	int tw = max(1, GV3::get<int>("faster_tree.tile_width", 256, 1));
+	int th = max(1, GV3::get<int>("faster_tree.tile_height", 64, 1));
+	int across = (x1 - x0 + tw - 1) / tw;
+	int down = (y1 - y0 + th - 1) / th;
+
+	shared_ptr<const block_bytecode> f2;
+	function<void(int, int, int, int, vector<int>&)> detect = region_detector(im, detector, threshold, f2);
+
+	//The tiles are numbered in raster order. The corners of a row of tiles are sorted
+	//in to raster order afterwards.
+	vector<pair<ImageRef, int> > found;
+	ordered_for(*detection_pool(), 0, across * down, 1, found, [&](int b, int e, vector<pair<ImageRef, int> >& r)
+	{
+		vector<ImageRef> c;
+		vector<int> cs;
+		for(int i=b; i < e; i++)
+		{
+			int tx = x0 + i % across * tw, ty = y0 + i / across * th;
+			c.clear();
+			cs.clear();
+			detect_tile(im, detect, *f2, threshold, tx, min(tx + tw, x1), ty, min(ty + th, y1), xmin, xmax, ymin, ymax, c, cs);
+			for(unsigned int j=0; j < c.size(); j++)
+				r.push_back(make_pair(c[j], cs[j]));
+		}
+	});
+
+	for(unsigned int b=0, e=0; b < found.size(); b = e)
+	{
+		int row = (found[b].first.y - y0) / th;
+		for(e = b; e < found.size() && (found[e].first.y - y0) / th == row; e++)
+		{}
+
+		sort(found.begin() + b, found.begin() + e, [](const pair<ImageRef, int>& p, const pair<ImageRef, int>& q)
+		{
+			return p.first.y < q.first.y || (p.first.y == q.first.y && p.first.x < q.first.x);
+		});
+	}
+
+	for(unsigned int i=0; i < found.size(); i++)
+	{
+		corners.push_back(found[i].first);
+		scores.push_back(found[i].second);
+	}
+}
+
 ///Tokenise a string.
 ///@param s String to be split
 ///@return Tokens
@@ -276,6 +739,220 @@ template<class C> C ato(const string & s)
 	return c;
 }
 
+///The value of a leaf, as used by tree_element::make_fast_detector(). A leaf on
+///an \c eq branch, or a leaf which is the whole tree, is never a corner.
+///@param t The leaf.
+///@param eq_branch Whether the leaf is on an \c eq branch, or is the root.
+///@return Whether the leaf is a corner.
+static bool leaf_value(const tree_element* t, bool eq_branch)
+{
+	return !eq_branch && t->is_corner;
+}
+
+///Do two subtrees give the same results? This compares structure, with leaves
+///compared by value (see leaf_value()).
+///@param a The first subtree.
+///@param a_eq Whether \c a is on an \c eq branch.
+///@param b The second subtree.
+///@param b_eq Whether \c b is on an \c eq branch.
+///@return Whether the subtrees are the same.
+static bool same_tree(const tree_element* a, bool a_eq, const tree_element* b, bool b_eq)
+{
+	if(a->is_leaf() || b->is_leaf())
+		return a->is_leaf() && b->is_leaf() && leaf_value(a, a_eq) == leaf_value(b, b_eq);
+	else
+		return a->offset_index == b->offset_index && same_tree(a->lt, 0, b->lt, 0) && same_tree(a->eq, 1, b->eq, 1) && same_tree(a->gt, 0, b->gt, 0);
+}
+
+///Replace a node with one of its children, if the child gives the same results in
+///the position of the node. A leaf which is a corner can not be moved to an \c eq 
+///branch, since it would stop being a corner.
+///@param t The node. It is deleted if it is replaced.
+///@param branch The child: 0, 1 or 2 for \c lt, \c eq or \c gt.
+///@param eq_branch Whether \c t is on an \c eq branch, or is the root.
+///@return The child, or NULL if \c t can not be replaced.
+static tree_element* hoist_branch(tree_element* t, int branch, bool eq_branch)
+{
+	tree_element** b[3] = {&t->lt, &t->eq, &t->gt};
+	tree_element* c = *b[branch];
+
+	if(c->is_leaf())
+	{
+		bool value = leaf_value(c, branch == 1);
+
+		if(eq_branch && value)
+			return 0;
+
+		c->is_corner = value;
+	}
+
+	*b[branch] = 0;
+	delete t;
+	return c;
+}
+
+///Optimize a subtree. See optimise_tree().
+///@param t The subtree. Ownership is taken.
+///@param eq_branch Whether \c t is on an \c eq branch, or is the root.
+///@param known The branch taken by each offset already tested on the path to \c t: 0, 1 or 2 for \c lt, \c eq or \c gt, or -1 if the offset has not been tested.
+///@return The optimized subtree.
+static tree_element* optimise_tree(tree_element* t, bool eq_branch, vector<signed char>& known)
+{
+	if(t->is_leaf())
+	{
+		t->is_corner = leaf_value(t, eq_branch);
+		return t;
+	}
+
+	int o = t->offset_index;
+	int k = known[o];
+
+	if(k != -1)
+	{
+		//The result of the test is already known, so the other branches are never taken.
+		tree_element* c = hoist_branch(t, k, eq_branch);
+		if(c)
+			return optimise_tree(c, eq_branch, known);
+
+		tree_element** b[3] = {&t->lt, &t->eq, &t->gt};
+		for(int i=0; i < 3; i++)
+			if(i != k)
+			{
+				delete *b[i];
+				*b[i] = new tree_element(false);
+			}
+	}
+
+	known[o] = 0;
+	t->lt = optimise_tree(t->lt, false, known);
+	known[o] = 1;
+	t->eq = optimise_tree(t->eq, true, known);
+	known[o] = 2;
+	t->gt = optimise_tree(t->gt, false, known);
+	known[o] = k;
+
+	//If all branches are the same, then the test makes no difference.
+	if(same_tree(t->lt, 0, t->eq, 1) && same_tree(t->gt, 0, t->eq, 1))
+		return hoist_branch(t, 1, eq_branch);
+
+	return t;
+}
+
+///Remove tests from a tree which can not change the result. A test is removed if
+///its result is implied by a test of the same offset higher up the tree, or if all 
+///three of its branches are the same. Branches which can not be reached are replaced 
+///with leaves. The optimized tree gives the same result as the original tree at every
+///point and every threshold, and so also gives the same scores.
+///@param t The tree. Ownership is taken.
+///@return The optimized tree. Ownership is passed to the caller.
+///@ingroup gTree
+tree_element* optimise_tree(tree_element* t)
+{
+	vector<signed char> known(num_offsets, -1);
+	return optimise_tree(t, true, known);
+}
+
+///Compute the expected number of tests made by a subtree. See tree_expected_tests().
+///@param t The subtree.
+///@param p_similar Probability that a pixel is similar to the centre.
+///@param known The branch taken by each offset already tested, as in optimise_tree().
+///@return The expected number of tests.
+static double tree_expected_tests(const tree_element* t, double p_similar, vector<signed char>& known)
+{
+	if(t->is_leaf())
+		return 0;
+
+	const tree_element* b[3] = {t->lt, t->eq, t->gt};
+	int o = t->offset_index;
+	int k = known[o];
+
+	if(k != -1)
+		return 1 + tree_expected_tests(b[k], p_similar, known);
+
+	double p[3] = {(1-p_similar)/2, p_similar, (1-p_similar)/2};
+	double e = 1;
+
+	for(int i=0; i < 3; i++)
+	{
+		known[o] = i;
+		e += p[i] * tree_expected_tests(b[i], p_similar, known);
+	}
+
+	known[o] = -1;
+	return e;
+}
+
+///Compute the expected number of tests made by a tree, in a single orientation, on 
+///one pixel. The result of each test is taken to be independent of the others,
+///except that testing the same offset twice gives the same result both times.
+///@param t The tree.
+///@param p_similar Probability that a pixel is neither much brighter nor much darker than the centre.
+///@return The expected number of tests.
+///@ingroup gTree
+double tree_expected_tests(const tree_element* t, double p_similar)
+{
+	vector<signed char> known(num_offsets, -1);
+	return tree_expected_tests(t, p_similar, known);
+}
+
+///Profile a tree, as applied by tree_element::detect_corner(), on an image. The nodes
+///of the profile are numbered as in tree_element::nth_element(), and the forms are
+///the orientations in ::offsets, without and then with intensity inversion.
+///@param t The tree.
+///@param im The image in which to detect corners
+///@param threshold Corner detector threshold to use
+///@param xmin x coordinate to start at.
+///@param ymin y coordinate to start at.
+///@param xmax x coordinate to go up to.
+///@param ymax y coordinate to go up to.
+///@param prof The counts are added to this.
+///@ingroup gTree
+void tree_profile(const tree_element* t, const SubImage<byte>& im, int threshold, int xmin, int xmax, int ymin, int ymax, detector_profile& prof)
+{
+	flat_tree f(*t);
+	int orientations = offsets.size();
+	prof.resize(f.num_nodes(), 2 * orientations);
+
+	for(int y = ymin; y < ymax; y++)
+		for(int x=xmin; x < xmax; x++)
+		{
+			int c = im[y][x];
+			prof.pixels++;
+
+			for(int form=0; form < 2 * orientations; form++)
+			{
+				bool invert = form >= orientations;
+				const vector<ImageRef>& o = offsets[form % orientations];
+				int n=0;
+
+				prof.reached[form]++;
+
+				while(!f.is_leaf(n))
+				{
+					prof.visits[n]++;
+					prof.tests[form]++;
+
+					int p = im[y + o[f[n].offset_index].y][x + o[f[n].offset_index].x];
+
+					if(p > c + threshold)
+						n = invert ? f.lt(n) : f.gt(n);
+					else if(p < c - threshold)
+						n = invert ? f.gt(n) : f.lt(n);
+					else
+						n = f.eq(n);
+				}
+
+				prof.visits[n]++;
+
+				if(f[n].is_corner)
+				{
+					prof.detected[form]++;
+					break;
+				}
+			}
+		}
+}
+
 ///Parses a tree from an istream. This will deserialize a tree serialized by ::tree_element::print().
 ///On error, ParseError is thrown.
 ///@param i The stream to parse
@@ -324,13 +1001,20 @@ tree_element* load_a_tree(istream& i, bool eq_branch)
 	}
 }
 
-///Parses a tree from an istream. This will deserialize a tree serialized by ::tree_element::print().
+///Parses a tree from an istream. This will deserialize a tree serialized by ::tree_element::print(),
+///or a tree in the binary format (see \ref gTreeFile).
 ///On error, ParseError is thrown.
 ///@param i The stream to parse
 ///@return An allocated tree. Ownership is passed to the callee.
 ///@ingroup gTree
 tree_element* load_a_tree(istream& i)
 {
+	if(is_binary_tree(i))
+	{
+		string data((istreambuf_iterator<char>(i)), istreambuf_iterator<char>());
+		return parse_binary_tree(data.data(), data.size()).tree()->copy();
+	}
+
 	return load_a_tree(i, true);
 }
 
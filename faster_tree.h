@@ -23,6 +23,7 @@
 #include <iostream>
 #include <string>
 #include <utility>
+#include <stdint.h>
 
 #include <cvd/image.h>
 #include <cvd/byte.h>
@@ -65,6 +66,27 @@ class tree_element
 		{
 			return eq == NULL;
 		}
+
+		///Compute a hash of the structure of the tree. Trees with the same structure
+		///compile to the same detector, so this identifies compiled detectors.
+		///
+		///@param h Hash of everything preceeding this node.
+		///@return Hash of the tree.
+		uint64_t hash(uint64_t h = 14695981039346656037ULL) const
+		{
+			//FNV-1a style mixing of the node contents in depth-first order.
+			const uint64_t prime = 1099511628211ULL;
+
+			if(eq == NULL)
+				return ((h ^ 2) * prime ^ is_corner) * prime;
+			else
+			{
+				h = ((h ^ 3) * prime ^ (uint64_t)offset_index) * prime;
+				h = lt->hash(h);
+				h = eq->hash(h);
+				return gt->hash(h);
+			}
+		}
 		
 
 		///Return a given numbered element of the tree. Elements are numbered by depth-first traversal.
@@ -82,24 +104,26 @@ class tree_element
 		///Compile the detector to bytecode. The bytecode is not a tree, but a graph. This is
 		///because the detector is applied in all orientations: offsets are integers which are
 		///indices in to a list of (x,y) offsets and there are multiple lists of offsets. The
-		///tree is also applied with intensity inversion.
+		///tree is also applied with intensity inversion. The bytecode holds the position of each
+		///pixel examined, so it can be used on images of any size.
 		///
-		///@param xsize The width of the image.
 		///@return The bytecode compiled detector.
 		///@ingroup gFastTree
-		block_bytecode make_fast_detector(int xsize) const
+		block_bytecode make_fast_detector() const
 		{
 			std::vector<block_bytecode::fast_detector_bit> f;
+			std::vector<int> roots;
 			
 			for(int invert=0; invert < 2; invert++)
 				for(unsigned int i=0; i <  offsets.size(); i++)
 				{	
 					//Make a FAST detector at a certain orientation
 					std::vector<block_bytecode::fast_detector_bit> tmp(1);
-					make_fast_detector_o(tmp, 0, xsize, i, invert);
+					make_fast_detector_o(tmp, 0, i, invert);
 
 					int endpos = f.size() + tmp.size();
 					int startpos = f.size();
+					roots.push_back(startpos);
 
 					//Append tmp on to f, filling in the non-corners (jumps to endpos)
 					//and correcting the intermediate jumps destinations
@@ -126,8 +150,10 @@ class tree_element
 				}
 
 			//We need a final endpoint for non-corners
+			roots.push_back(f.size());
 			f.resize(f.size() + 1);
-			f.back().offset = 0;
+			f.back().x = 0;
+			f.back().y = 0;
 			f.back().lt = 0;
 			f.back().gt = 0;
 			f.back().eq = 0;
@@ -143,12 +169,15 @@ class tree_element
 			}
 
 			f.resize(f.size() + 1);
-			f.back().offset = 0;
+			f.back().x = 0;
+			f.back().y = 0;
 			f.back().lt = 0;
 			f.back().gt = 1;
 			f.back().eq = 0;
 
-			block_bytecode r = {f};
+			block_bytecode r;
+			r.d.swap(f);
+			r.roots.swap(roots);
 			
 			return r;
 		}
@@ -166,11 +195,10 @@ class tree_element
 		///
 		///@param v Bytecode storage
 		///@param n Position in v to compile the bytecode to
-		///@param xsize Width of the image
 		///@param N orientation of the tree
 		///@param invert whether or not to perform and intensity inversion.
 		///@ingroup gFastTree
-		void make_fast_detector_o(std::vector<block_bytecode::fast_detector_bit>& v, int n,int xsize, int N, bool invert) const
+		void make_fast_detector_o(std::vector<block_bytecode::fast_detector_bit>& v, int n, int N, bool invert) const
 		{
 			//-1 for non-corner
 			//-2 for corner
@@ -179,14 +207,16 @@ class tree_element
 			{
 				//If the tree is a single leaf, then we end up here. In this case, it must be 
 				//a non-corner, otherwise the strength would be inf.
-				v[n].offset = 0;
+				v[n].x = 0;
+				v[n].y = 0;
 				v[n].lt = -1;
 				v[n].gt = -1;
 				v[n].eq = -1;
 			}
 			else
 			{
-				v[n].offset = offsets[N][offset_index].x + offsets[N][offset_index].y * xsize;
+				v[n].x = offsets[N][offset_index].x;
+				v[n].y = offsets[N][offset_index].y;
 
 				if(eq->is_leaf())
 					v[n].eq = -1; //Can only be non-corner!
@@ -194,7 +224,7 @@ class tree_element
 				{
 					v[n].eq = v.size();
 					v.resize(v.size() + 1);
-					eq->make_fast_detector_o(v, v[n].eq, xsize, N, invert);
+					eq->make_fast_detector_o(v, v[n].eq, N, invert);
 				}
 
 				const tree_element* llt = lt;
@@ -211,7 +241,7 @@ class tree_element
 				{
 					v[n].lt = v.size();
 					v.resize(v.size() + 1);
-					llt->make_fast_detector_o(v, v[n].lt, xsize, N, invert);
+					llt->make_fast_detector_o(v, v[n].lt, N, invert);
 				}
 
 
@@ -221,7 +251,7 @@ class tree_element
 				{
 					v[n].gt = v.size();
 					v.resize(v.size() + 1);
-					lgt->make_fast_detector_o(v, v[n].gt, xsize, N, invert);
+					lgt->make_fast_detector_o(v, v[n].gt, N, invert);
 				}
 			}
 		}
@@ -276,7 +306,7 @@ class tree_element
 		/// @param n tree orientation to use (index in to offsets)
 		/// @param invert Whether to perform an intensity inversion
 		/// @return 0 for no corner, otherwise smallet amount by which a test passed.
-		int detect_corner_oriented(const CVD::Image<CVD::byte>& im, CVD::ImageRef pos, int b, int n, bool invert) const
+		int detect_corner_oriented(const CVD::SubImage<CVD::byte>& im, CVD::ImageRef pos, int b, int n, bool invert) const
 		{
 			//Return number that threshold would have to be increased to in
 			//order to change the outcome
@@ -312,7 +342,7 @@ class tree_element
 		/// @param pos position at which to perform detection
 		/// @param b Threshold
 		/// @return 0 for no corner, otherwise smallet amount by which a test passed.
-		int detect_corner(const CVD::Image<CVD::byte>& im, CVD::ImageRef pos, int b) const
+		int detect_corner(const CVD::SubImage<CVD::byte>& im, CVD::ImageRef pos, int b) const
 		{
 			for(int invert=0; invert <2; invert++)
 				for(unsigned int i=0; i < offsets.size(); i++)
@@ -325,7 +355,7 @@ class tree_element
 		}
 
 		/// Deep copy the tree.
-		tree_element* copy()
+		tree_element* copy() const
 		{
 			tree_element* t = new tree_element(*this);
 			if(eq != NULL)
@@ -349,7 +379,7 @@ class tree_element
 				o << ind << "Is corner: " << is_corner << " " << this << " " << lt << " " << eq << " " << gt << "\n";
 			else
 			{
-				o << ind << offset_index << " " << this << lt << " " << eq << " " << gt << "\n";
+				o << ind << offset_index << " " << this << " " << lt << " " << eq << " " << gt << "\n";
 				lt->print(o, ind + "  ");
 				eq->print(o, ind + "  ");
 				gt->print(o, ind + "  ");
@@ -383,8 +413,17 @@ class tree_element
 
 
 tree_element* load_a_tree(std::istream& i);
-std::vector<CVD::ImageRef> tree_detect_corners(const CVD::Image<CVD::byte>& im, const tree_element* detector, int threshold, CVD::Image<int> scores);
-std::vector<CVD::ImageRef> tree_detect_corners_all(const CVD::Image<CVD::byte>& im, const tree_element* detector, int threshold);
+tree_element* optimise_tree(tree_element* t);
+double tree_expected_tests(const tree_element* t, double p_similar);
+void tree_profile(const tree_element* t, const CVD::SubImage<CVD::byte>& im, int threshold, int xmin, int xmax, int ymin, int ymax, detector_profile& prof);
+std::vector<CVD::ImageRef> tree_detect_corners(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold, CVD::Image<int> scores);
+std::vector<CVD::ImageRef> tree_detect_corners_all(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold);
+void tree_detect_corners_stream(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold, std::vector<CVD::ImageRef>& corners, std::vector<int>& scores);
+void tree_detect_corners_masked(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold, const run_mask& mask, std::vector<CVD::ImageRef>& corners, std::vector<int>& scores);
+void tree_detect_corners_tile(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold, CVD::ImageRef pos, CVD::ImageRef size, std::vector<CVD::ImageRef>& corners, std::vector<int>& scores);
+void tree_detect_corners_tiled(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold, std::vector<CVD::ImageRef>& corners, std::vector<int>& scores);
+void tree_detect_corners_tiled(const CVD::SubImage<CVD::byte>& im, const tree_element* detector, int threshold, CVD::ImageRef pos, CVD::ImageRef size, std::vector<CVD::ImageRef>& corners, std::vector<int>& scores);
+std::pair<CVD::ImageRef, CVD::ImageRef> tree_detect_halo(const tree_element* detector);
 
 
 ///A named symbol to throw in the case that 
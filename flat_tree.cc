@@ -0,0 +1,214 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "flat_tree.h"
+
+#include <memory>
+
+///\cond never
+using namespace std;
+///\endcond
+
+///Make a tree consisting of a single leaf.
+///@param is_corner Class of the leaf.
+flat_tree::flat_tree(bool is_corner)
+{
+	node n = {0, 1, is_corner, true};
+	nodes.push_back(n);
+}
+
+///Flatten a tree.
+///@param t The tree.
+flat_tree::flat_tree(const tree_element& t)
+{
+	nodes.reserve(t.num_nodes());
+	append(&t, true);
+}
+
+///Make a tree from a list of nodes.
+///@param n The nodes, in depth-first order, with the subtree sizes and \c eq_branch flags filled in.
+flat_tree::flat_tree(const vector<node>& n)
+:nodes(n)
+{
+}
+
+///Copy a tree. The view made by tree() is not copied.
+///@param t The tree to copy.
+flat_tree::flat_tree(const flat_tree& t)
+:nodes(t.nodes)
+{
+}
+
+///Copy a tree. The view made by tree() is discarded.
+///@param t The tree to copy.
+flat_tree& flat_tree::operator=(const flat_tree& t)
+{
+	clear_view();
+	nodes = t.nodes;
+	return *this;
+}
+
+flat_tree::~flat_tree()
+{
+	clear_view();
+}
+
+///Append a tree in depth-first order.
+///@param t The tree.
+///@param eq_branch Whether \c t is the \c eq branch of its parent.
+void flat_tree::append(const tree_element* t, bool eq_branch)
+{
+	int n = nodes.size();
+	node d = {t->offset_index, 1, t->is_corner, eq_branch};
+	nodes.push_back(d);
+
+	if(!t->is_leaf())
+	{
+		append(t->lt, false);
+		append(t->eq, true);
+		append(t->gt, false);
+		nodes[n].size = nodes.size() - n;
+	}
+}
+
+///Replace a subtree with a copy of a subtree of another tree (which may be this tree).
+///The replacement keeps the \c eq_branch flag of the subtree it replaces.
+///@param n The root of the subtree to replace.
+///@param t The tree to copy from.
+///@param m The root of the subtree of \c t to copy.
+void flat_tree::replace(int n, const flat_tree& t, int m)
+{
+	clear_view();
+
+	vector<node> sub(t.nodes.begin() + m, t.nodes.begin() + m + t.nodes[m].size);
+	sub[0].eq_branch = nodes[n].eq_branch;
+
+	int old_size = nodes[n].size;
+	int change = sub.size() - old_size;
+
+	//The subtree sizes of everything above n change.
+	for(int a=0; a != n; )
+	{
+		nodes[a].size += change;
+
+		if(n < eq(a))
+			a = lt(a);
+		else if(n < gt(a))
+			a = eq(a);
+		else
+			a = gt(a);
+	}
+
+	if(change > 0)
+		nodes.insert(nodes.begin() + n, change, sub[0]);
+	else
+		nodes.erase(nodes.begin() + n, nodes.begin() + n - change);
+
+	copy(sub.begin(), sub.end(), nodes.begin() + n);
+}
+
+///Replace a subtree with a leaf.
+///@param n The root of the subtree to replace.
+///@param is_corner The class of the leaf.
+void flat_tree::make_leaf(int n, bool is_corner)
+{
+	replace(n, flat_tree(is_corner));
+}
+
+///Compute a hash of the structure of the tree. This is the same as tree_element::hash().
+///@return Hash of the tree.
+uint64_t flat_tree::hash() const
+{
+	const uint64_t prime = 1099511628211ULL;
+	uint64_t h = 14695981039346656037ULL;
+
+	for(unsigned int i=0; i < nodes.size(); i++)
+		if(nodes[i].size == 1)
+			h = ((h ^ 2) * prime ^ nodes[i].is_corner) * prime;
+		else
+			h = ((h ^ 3) * prime ^ (uint64_t)nodes[i].offset_index) * prime;
+
+	return h;
+}
+
+///Discard the view made by tree(). The nodes of the view point to each other,
+///and a ::tree_element deletes its children, so they are unlinked first.
+void flat_tree::clear_view()
+{
+	for(unsigned int i=0; i < view.size(); i++)
+		view[i].lt = view[i].eq = view[i].gt = 0;
+	view.clear();
+}
+
+///Make a ::tree_element view of the tree, so that it can be used with the functions which
+///take a ::tree_element, such as tree_detect_corners(). The nodes of the view are stored in
+///a single array which is reused, so no memory is allocated once it is large enough. The 
+///view is owned by the flat_tree, and is valid until the tree is next changed or tree() is 
+///next called.
+///@return The root of the view.
+const tree_element* flat_tree::tree()
+{
+	clear_view();
+
+	//The storage must not move once the nodes point in to it.
+	view.reserve(nodes.size());
+	for(unsigned int i=0; i < nodes.size(); i++)
+	{
+		view.push_back(tree_element(nodes[i].is_corner));
+		view.back().offset_index = nodes[i].offset_index;
+	}
+
+	for(unsigned int i=0; i < nodes.size(); i++)
+		if(!is_leaf(i))
+		{
+			view[i].lt = &view[lt(i)];
+			view[i].eq = &view[eq(i)];
+			view[i].gt = &view[gt(i)];
+		}
+
+	return &view[0];
+}
+
+///Compile the detector to bytecode. See tree_element::make_fast_detector(). The view
+///is made from a copy of the tree, so any view returned by tree() remains valid.
+///@return The bytecode compiled detector.
+block_bytecode flat_tree::make_fast_detector() const
+{
+	flat_tree t(*this);
+	return t.tree()->make_fast_detector();
+}
+
+///Serialize the tree, in the same way as tree_element::print(). As with
+///make_fast_detector(), a copy of the tree is used.
+///@param o Stream to serialize to.
+void flat_tree::print(ostream& o) const
+{
+	flat_tree t(*this);
+	t.tree()->print(o);
+}
+
+///Parses a tree from an istream. See load_a_tree().
+///@param i The stream to parse
+///@return The tree.
+///@ingroup gTree
+flat_tree load_a_flat_tree(istream& i)
+{
+	unique_ptr<tree_element> t(load_a_tree(i));
+	return flat_tree(*t);
+}
@@ -0,0 +1,128 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_FLAT_TREE_H
+#define INC_FLAT_TREE_H
+
+#include <vector>
+#include <iostream>
+#include <utility>
+#include <stdint.h>
+
+#include "faster_tree.h"
+
+///This class holds a tree in a single array, with the nodes in depth-first order (each
+///node is followed by its \c lt, \c eq and \c gt subtrees), so there is no memory allocation
+///per node. Each node stores the size of its subtree, from which its children are found.
+///The nodes are numbered in the same order as tree_element::nth_element(), so finding a node
+///by number is an array lookup, counting the nodes is constant time and copying a tree is a
+///single copy of the array.
+///
+///The compiled detectors, and the functions which use them, work on ::tree_element, so 
+///tree() provides a ::tree_element view of the tree. Making a view invalidates the previous
+///one, so tree() is not const.
+///@ingroup gTree
+class flat_tree
+{
+	public:
+		///A node of the tree.
+		struct node
+		{
+			int  offset_index; ///< Offset number of the pixel to examine. This indexes offsets[x].
+			int  size;         ///< Number of nodes in the subtree starting here. This is 1 for a leaf.
+			bool is_corner;    ///< If the node is a leaf, then this is its attribute.
+			bool eq_branch;    ///< Whether the node is the \c eq branch of its parent. This is true for the root.
+		};
+
+		flat_tree(bool is_corner=false);
+		flat_tree(const tree_element& t);
+		flat_tree(const std::vector<node>& n);
+		flat_tree(const flat_tree& t);
+		flat_tree& operator=(const flat_tree& t);
+		~flat_tree();
+
+		///This returns the number of nodes in the tree
+		int num_nodes() const
+		{
+			return nodes.size();
+		}
+
+		///Is a node a leaf?
+		///@param n The node number.
+		bool is_leaf(int n) const
+		{
+			return nodes[n].size == 1;
+		}
+
+		///The \c lt branch of a node which is not a leaf.
+		///@param n The node number.
+		int lt(int n) const
+		{
+			return n + 1;
+		}
+
+		///The \c eq branch of a node which is not a leaf.
+		///@param n The node number.
+		int eq(int n) const
+		{
+			return lt(n) + nodes[lt(n)].size;
+		}
+
+		///The \c gt branch of a node which is not a leaf.
+		///@param n The node number.
+		int gt(int n) const
+		{
+			return eq(n) + nodes[eq(n)].size;
+		}
+
+		///Access a node. The number of nodes in a subtree must only be changed with replace().
+		///@param n The node number.
+		node& operator[](int n)
+		{
+			return nodes[n];
+		}
+
+		///Access a node.
+		///@param n The node number.
+		const node& operator[](int n) const
+		{
+			return nodes[n];
+		}
+
+		void replace(int n, const flat_tree& t, int m=0);
+		void make_leaf(int n, bool is_corner);
+		uint64_t hash() const;
+
+		const tree_element* tree();
+		block_bytecode make_fast_detector() const;
+		void print(std::ostream& o) const;
+
+	private:
+		friend class persistent_tree;
+
+		void append(const tree_element* t, bool eq_branch);
+		void clear_view();
+
+		std::vector<node> nodes;                  ///< The nodes, in depth-first order.
+		std::vector<tree_element> view;           ///< Storage for the view returned by tree().
+};
+
+flat_tree load_a_flat_tree(std::istream& i);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "large_image.h"
+#include "faster_tree.h"
+
+#include <limits>
+#include <climits>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <cvd/image.h>
+
+///\cond never
+using namespace std;
+using namespace CVD;
+///\endcond
+
+///Read the next number from a PGM header, skipping whitespace and comments.
+///@param i Stream to read from.
+///@return The number.
+static int64_t pgm_number(istream& i)
+{
+	while(i.good())
+	{
+		int c = i.peek();
+		if(c == '#')
+			i.ignore(numeric_limits<streamsize>::max(), '\n');
+		else if(isspace(c))
+			i.get();
+		else
+			break;
+	}
+
+	int64_t n;
+	i >> n;
+	if(!i.good())
+		throw ParseError();
+
+	return n;
+}
+
+///Read the header of a PGM image. Only 8 bit binary PGMs are supported.
+///@param i Stream to read the image from. The pixels are read from this by read().
+pgm_reader::pgm_reader(istream& i)
+:in(i)
+{
+	char magic[2];
+	if(!in.read(magic, 2) || magic[0] != 'P' || magic[1] != '5')
+		throw ParseError();
+
+	int64_t width = pgm_number(in);
+	h = pgm_number(in);
+	int64_t maxval = pgm_number(in);
+
+	if(width <= 0 || width > INT_MAX || h <= 0 || maxval <= 0 || maxval > 255)
+		throw ParseError();
+	w = width;
+
+	//A single whitespace character separates the header from the pixels.
+	in.get();
+}
+
+///Read the next rows of the image.
+///@param rows The rows are stored here, one after another.
+///@param n Number of rows to read.
+///@return Whether all the rows could be read.
+bool pgm_reader::read(CVD::byte* rows, int n)
+{
+	return in.read(reinterpret_cast<char*>(rows), static_cast<streamsize>(n) * w).good();
+}
+
+///Detect corners with nonmaximal suppression in an image which is too large to hold in memory.
+///The image is read in bands of rows, and only one band is held at once, along with the rows 
+///above and below it which the detector needs (see tree_detect_halo()). Each band is processed
+///by tree_detect_corners_tiled(), and its corners are passed on as soon as it is finished, so 
+///the memory used depends on the width of the image, but not on its height. The corners and
+///scores are the same as those of tree_detect_corners() on the whole image.
+///
+///Positions within a band fit in an \c int, but positions within the image may not, so the
+///corner positions are given as 64 bit numbers. If the image ends early, the program exits
+///with an error.
+///
+///@param in The image.
+///@param detector The corner detector.
+///@param threshold The detector threshold.
+///@param band Number of rows in a band.
+///@param corner Called as <code>corner(x, y, score)</code> for every corner, in raster order.
+///@ingroup gTree
+void tree_detect_corners_large(pgm_reader& in, const tree_element* detector, int threshold, int band, const function<void(int64_t, int64_t, int)>& corner)
+{
+	pair<ImageRef, ImageRef> halo = tree_detect_halo(detector);
+	int above = halo.first.y, below = halo.second.y;
+	int w = in.width();
+	int64_t h = in.height();
+
+	//The compiled detectors find corners as offsets in to the buffer, which are ints.
+	band = min(band, INT_MAX / w - above - below);
+	if(band < 1)
+	{
+		cerr << "Error: image is too wide (" << w << " pixels)" << endl;
+		exit(1);
+	}
+
+	Image<CVD::byte> buffer(ImageRef(w, band + above + below));
+	int64_t start = 0; //Row of the image held in the first row of the buffer
+	int rows = 0;      //Number of rows held in the buffer
+
+	vector<ImageRef> c;
+	vector<int> s;
+
+	for(int64_t y0=0; y0 < h; y0 += band)
+	{
+		int64_t first = max<int64_t>(y0 - above, 0);
+		int64_t end = min<int64_t>(y0 + band + below, h);
+
+		//Keep the rows of the last band which overlap with this one, and read the rest.
+		int keep = start + rows - first;
+		if(keep > 0)
+			memmove(buffer.data(), buffer[first - start], static_cast<size_t>(keep) * w);
+		start = first;
+		rows = end - start;
+
+		if(!in.read(buffer[keep], rows - keep))
+		{
+			cerr << "Error: image ends before row " << start + rows << endl;
+			exit(1);
+		}
+
+		tree_detect_corners_tiled(buffer.sub_image(ImageRef(0, 0), ImageRef(w, rows)), detector, threshold, ImageRef(0, y0 - start), ImageRef(w, min<int64_t>(band, h - y0)), c, s);
+
+		for(unsigned int i=0; i < c.size(); i++)
+			corner(c[i].x, c[i].y + start, s[i]);
+	}
+}
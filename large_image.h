@@ -0,0 +1,61 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_LARGE_IMAGE_H
+#define INC_LARGE_IMAGE_H
+
+#include <iostream>
+#include <functional>
+#include <stdint.h>
+#include <cvd/byte.h>
+
+class tree_element;
+
+///This class reads a binary (P5) PGM image a few rows at a time, so that images which
+///are too large to fit in memory can be processed. The image is read from a stream, so
+///it may come from a pipe as well as from a file.
+///@ingroup gUtility
+class pgm_reader
+{
+	public:
+		pgm_reader(std::istream& i);
+
+		bool read(CVD::byte* rows, int n);
+
+		///Width of the image.
+		int width() const
+		{
+			return w;
+		}
+
+		///Height of the image. This may exceed the range of an \c int.
+		int64_t height() const
+		{
+			return h;
+		}
+
+	private:
+		std::istream& in; ///< Stream the image is read from
+		int w;            ///< Width of the image
+		int64_t h;        ///< Height of the image
+};
+
+void tree_detect_corners_large(pgm_reader& in, const tree_element* detector, int threshold, int band, const std::function<void(int64_t, int64_t, int)>& corner);
+
+#endif
@@ -32,6 +32,12 @@ be extracted from the output with the following command:
 
 <code>awk 'a&&!NF{exit}a;/Final tree/{a=1}' </code><i>filename</i>
 
+The final tree is followed by an optimised version of it (see ::optimise_tree()), 
+which gives exactly the same results with fewer tests, and can be extracted by replacing
+<code>Final tree</code> with <code>Optimised tree</code> in the command above.
+Last comes the block detector compiled from the optimised tree. If \c optimise.minimise_blocks
+is set, then identical blocks are merged first (see block_bytecode::minimise()).
+
 This file contains a direct implementation of section V of the accompanying
 paper, in the function ::learn_detector. For more information, refer to the
 section on \link gOptimize optimization\endlink.
@@ -64,6 +70,7 @@ For details on how the data loading and so on operated, refer to
 #include <algorithm>
 #include <array>
 #include <random>
+#include <memory>
 
 #include <cvd/image_io.h>
 #include <cvd/vector_image_ref.h>
@@ -72,6 +79,8 @@ For details on how the data loading and so on operated, refer to
 
 #include "gvars_vector.h"
 #include "faster_tree.h"
+#include "flat_tree.h"
+#include "persistent_tree.h"
 #include "faster_bytecode.h"
 #include "offsets.h"
 #include "utility.h"
@@ -258,7 +267,7 @@ double compute_temperature(int i, int imax)
 ///@param images The training images
 ///@param warps  Warps for evaluating the performance on the training images.
 ///@return An optimized detector.
-tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vector<vector<Image<array<float,2> > > >& warps)
+flat_tree learn_detector(const vector<Image<CVD::byte> >& images, const vector<vector<Image<array<float,2> > > >& warps)
 {
 	unsigned int  iterations=GV3::get<unsigned int>("iterations");       // Number of iterations of simulated annealing.
 	int threshold = GV3::get<int>("FAST_threshold");                     // Threshold at which to perform detection
@@ -277,8 +286,14 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 	//Preallocated space for nonmax-suppression. See tree_detect_corners()
 	Image<int> scratch_scores(image_size, 0);
 
-	//Start with an initial random tree
-	tree_element* tree = random_tree(GV3::get<int>("initial_tree_depth"));
+	//Start with an initial random tree. Copies of the tree share all unchanged
+	//nodes, so making and discarding a modified copy is cheap.
+	unique_ptr<tree_element> initial_tree(random_tree(GV3::get<int>("initial_tree_depth")));
+	persistent_tree tree(*initial_tree);
+	initial_tree.reset();
+
+	//Storage for the tree being evaluated.
+	flat_tree flat;
 	
 	for(unsigned int itnum=0; itnum < iterations; itnum++)
 	{
@@ -308,8 +323,8 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 		*/
 
 
-		//Deep copy in to new_tree and work with the copy.
-		tree_element* new_tree = tree->copy();
+		//Copy in to new_tree and work with the copy.
+		persistent_tree new_tree = tree;
 
 		cout << "\n\n-------------------------------------\n";
 		cout << "Iteration " << itnum << endl;
@@ -317,7 +332,8 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 		if(GV3::get<bool>("debug.print_old_tree"))
 		{
 			cout << "Old tree is:" << endl;
-			tree->print(cout);
+			tree.flatten(flat);
+			flat.print(cout);
 		}
 	
 		//Skip tree modification first time so that the randomly generated
@@ -326,39 +342,32 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 		{
 
 			//Create a tree permutation
-			tree_element* node;
-			bool node_is_eq;
-			
 
 			//Select a random node
-			int nnum = rand() % new_tree->num_nodes();
-			tie(node, node_is_eq) = new_tree->nth_element(nnum);
+			int node = rand() % new_tree.num_nodes();
+			bool node_is_eq = new_tree.eq_branch(node);
 
-			cout << "Permuting tree at node " << nnum << endl;
+			cout << "Permuting tree at node " << node << endl;
 			cout << "Node " << node << " " << node_is_eq << endl;
 			
 
 			//See section 4 in the paper.
-			if(node->eq == NULL) //A leaf
+			if(new_tree.is_leaf(node)) //A leaf
 			{
 				if(rand() % 2 || node_is_eq)  //Operation 1, invariant 1
 				{
 					cout << "Growing a subtree:\n";
 					//Grow a subtree
-					tree_element* stub = random_tree(1);
+					unique_ptr<tree_element> stub(random_tree(1));
 
 					stub->print(cout);
 
-					//Splice it on manually (ick)
-					*node = *stub;
-					stub->lt = stub->eq = stub->gt = 0;
-					delete stub;
-
+					new_tree.replace(node, persistent_tree(*stub));
 				}
 				else //Operation 2
 				{
 					cout << "Flipping the classification\n";
-					node->is_corner  = ! node->is_corner;
+					new_tree.set_corner(node, ! new_tree.is_corner(node));
 				}
 			}
 			else //A node
@@ -368,7 +377,7 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 				if(d < 1./3.) //Randomize the test
 				{
 					cout << "Randomizing the test\n";
-					node->offset_index = rand() % num_offsets;
+					new_tree.set_offset_index(node, rand() % num_offsets);
 				}
 				else if(d < 2./3.)
 				{
@@ -379,32 +388,9 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 
 					cout << "Copying branches " << c << " to " << r <<endl;
 
-					//Deep copy node c: it's a tree, not a graph.
-					tree_element* tmp;
-
-					if(c == 0)
-						tmp = node->lt->copy();
-					else if(c == 1)
-						tmp = node->eq->copy();
-					else
-						tmp = node->gt->copy();
-					
-					//Delete r and put the copy of c in its place
-					if(r == 0)
-					{
-						delete node->lt;
-						node->lt = tmp;
-					}
-					else if(r == 1)
-					{
-						delete node->eq;
-						node->eq = tmp;
-					}
-					else 
-					{
-						delete node->gt;
-						node->gt = tmp;
-					}
+					//Replace branch r with a copy of branch c: it's a tree, not a graph.
+					int branch[3] = {new_tree.lt(node), new_tree.eq(node), new_tree.gt(node)};
+					new_tree.replace(branch[r], new_tree, branch[c]);
 
 					//NB BUG!!!
 					//At this point the invariant can be broken,
@@ -416,8 +402,8 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 					//when it can decuce its structure from the invariant.
 
 					//The following line should have been present in the paper:
-					if(node->eq->is_leaf())
-					    node->eq->is_corner = 0;
+					if(new_tree.is_leaf(new_tree.eq(node)))
+					    new_tree.set_corner(new_tree.eq(node), 0);
 
 					//Happily, because the bytecode compiler deduces this
 					//it behaves as if this line was present, at evaluation time.
@@ -428,31 +414,29 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 				else //Splat!!! ie delete a subtree
 				{
 					cout << "Splat!!!1\n";
-					delete node->lt;
-					delete node->eq;
-					delete node->gt;
-					node->lt = node->eq = node->gt = 0;
-
 					if(node_is_eq) //Maintain invariant 1
-						node->is_corner = 0;
+						new_tree.make_leaf(node, 0);
 					else
-						node->is_corner = rand()%2;
+						new_tree.make_leaf(node, rand()%2);
 				}
 			}
 		}
 		first_time=0;
 
+		new_tree.flatten(flat);
+
 		if(GV3::get<bool>("debug.print_new_tree"))
 		{
 			cout << "New tree is: "<< endl;
-			new_tree->print(cout);
+			flat.print(cout);
 		}
 	
 		
 		//Detect all corners in all images
 		vector<vector<ImageRef> > detected_corners;
+		const tree_element* new_tree_view = flat.tree();
 		for(unsigned int i=0; i < images.size(); i++)
-			detected_corners.push_back(tree_detect_corners(images[i], new_tree, threshold, scratch_scores));
+			detected_corners.push_back(tree_detect_corners(images[i], new_tree_view, threshold, scratch_scores));
 
 
 		//Compute repeatability and assosciated cost
@@ -471,7 +455,7 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 		cout << "Number cost " << number_cost << endl;
 
 		//Cost associated with tree size
-		double size_cost = 1 + sq(1.0 * new_tree->num_nodes()/max_nodes);
+		double size_cost = 1 + sq(1.0 * new_tree.num_nodes()/max_nodes);
 		
 		//The overall cost function
 		double cost = size_cost * repeatability_cost * number_cost;
@@ -489,7 +473,7 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 		cout << "Temperature" << temperature << endl;
 		cout << "Number cost" << number_cost << endl;
 		cout << "Repeatability" << repeatability << " " << repeatability_cost << endl;
-		cout << "Nodes" << new_tree->num_nodes() << " " << size_cost << endl;
+		cout << "Nodes" << new_tree.num_nodes() << " " << size_cost << endl;
 		cout << "Cost" << cost << endl;
 		cout << "Old cost" << old_cost << endl;
 		cout << "Liklihood" << liklihood << endl;
@@ -499,21 +483,18 @@ tree_element* learn_detector(const vector<Image<CVD::byte> >& images, const vect
 		{
 			cout << "Keeping change" << endl;
 			old_cost = cost;
-			delete tree;
 			tree = new_tree;
 		}
 		else
-		{
 			cout << "Rejecting change" << endl;
-			delete new_tree;
-		}
 		
 		cout << "Final cost " << old_cost << endl;
 
 	}
 
 
-	return tree;
+	tree.flatten(flat);
+	return flat;
 }
 
 
@@ -553,17 +534,34 @@ void run_learn_detector(int argc, char** argv)
 
 
 	//Learn a detector
-	tree_element* tree = learn_detector(images, warps);
+	flat_tree tree = learn_detector(images, warps);
 
 	//Print out the results
 	cout << "Final tree is:" << endl;
-	tree->print(cout);
+	tree.print(cout);
 	cout << endl;
 
-	cout << "Final block detector is:" << endl;
+	//Remove tests which can not change the result before compiling the tree.
 	{
-		block_bytecode f = tree->make_fast_detector(9999);
-		f.print(cout, 9999);
+		unique_ptr<tree_element> optimised(optimise_tree(tree.tree()->copy()));
+		double p_similar = GV3::get<double>("optimise.p_similar");
+
+		cout << "Optimisation reduced the nodes from " << tree.num_nodes() << " to " << optimised->num_nodes()
+			<< " and the expected tests per orientation from " << tree_expected_tests(tree.tree(), p_similar) 
+			<< " to " << tree_expected_tests(optimised.get(), p_similar) << "." << endl;
+		cout << "Optimised tree is:" << endl;
+		optimised->print(cout);
+		cout << endl;
+
+		block_bytecode f = optimised->make_fast_detector();
+		if(GV3::get<bool>("optimise.minimise_blocks"))
+		{
+			int blocks = f.d.size();
+			f.minimise();
+			cout << "Block detector has " << blocks << " blocks, " << f.d.size() << " after minimisation." << endl;
+		}
+		cout << "Final block detector is:" << endl;
+		f.print(cout);
 	}
 }
 
@@ -0,0 +1,283 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "persistent_tree.h"
+
+///\cond never
+using namespace std;
+///\endcond
+
+///Make a copy of a tree.
+///@param t The tree.
+persistent_tree::persistent_tree(const tree_element& t)
+:root(make(&t))
+{
+}
+
+///Make a tree consisting of a single leaf.
+///@param is_corner Class of the leaf.
+persistent_tree::persistent_tree(bool is_corner)
+{
+	node* l = new node;
+	l->offset_index = 0;
+	l->size = 1;
+	l->is_corner = is_corner;
+	root.reset(l);
+}
+
+///Make a copy of a subtree.
+///@param t The subtree.
+///@return The copy.
+persistent_tree::node_ptr persistent_tree::make(const tree_element* t)
+{
+	node* n = new node;
+	node_ptr r(n);
+	n->offset_index = t->offset_index;
+	n->is_corner = t->is_corner;
+	n->size = 1;
+
+	if(!t->is_leaf())
+	{
+		n->lt = make(t->lt);
+		n->eq = make(t->eq);
+		n->gt = make(t->gt);
+		n->size += n->lt->size + n->eq->size + n->gt->size;
+	}
+
+	return r;
+}
+
+///Find a numbered node of the tree.
+///@param n The node number.
+///@param eq_branch Set to whether the node is the \c eq branch of its parent. This is true for the root.
+///@return The node.
+const persistent_tree::node_ptr& persistent_tree::find(int n, bool& eq_branch) const
+{
+	const node_ptr* t = &root;
+	eq_branch = true;
+
+	while(n != 0)
+	{
+		n--;
+		eq_branch = false;
+
+		const node& c = **t;
+
+		if(n < c.lt->size)
+			t = &c.lt;
+		else if((n -= c.lt->size) < c.eq->size)
+		{
+			t = &c.eq;
+			eq_branch = true;
+		}
+		else
+		{
+			n -= c.eq->size;
+			t = &c.gt;
+		}
+	}
+
+	return *t;
+}
+
+///Find a numbered node of the tree.
+///@param n The node number.
+///@return The node.
+const persistent_tree::node_ptr& persistent_tree::find(int n) const
+{
+	bool e;
+	return find(n, e);
+}
+
+///Is a node a leaf?
+///@param n The node number.
+bool persistent_tree::is_leaf(int n) const
+{
+	return find(n)->size == 1;
+}
+
+///The class of a leaf.
+///@param n The node number.
+bool persistent_tree::is_corner(int n) const
+{
+	return find(n)->is_corner;
+}
+
+///The offset number of the pixel examined by a node.
+///@param n The node number.
+int persistent_tree::offset_index(int n) const
+{
+	return find(n)->offset_index;
+}
+
+///Is a node the \c eq branch of its parent? This is true for the root.
+///@param n The node number.
+bool persistent_tree::eq_branch(int n) const
+{
+	bool e;
+	find(n, e);
+	return e;
+}
+
+///The \c lt branch of a node which is not a leaf.
+///@param n The node number.
+int persistent_tree::lt(int n) const
+{
+	return n + 1;
+}
+
+///The \c eq branch of a node which is not a leaf.
+///@param n The node number.
+int persistent_tree::eq(int n) const
+{
+	return n + 1 + find(n)->lt->size;
+}
+
+///The \c gt branch of a node which is not a leaf.
+///@param n The node number.
+int persistent_tree::gt(int n) const
+{
+	const node_ptr& t = find(n);
+	return n + 1 + t->lt->size + t->eq->size;
+}
+
+///Replace a numbered node of a subtree, copying the nodes on the path to it.
+///@param t The subtree.
+///@param n The node number, within the subtree.
+///@param f Function making the replacement from the old node.
+///@return The new subtree.
+persistent_tree::node_ptr persistent_tree::edit(const node_ptr& t, int n, const function<node_ptr(const node*)>& f)
+{
+	if(n == 0)
+		return f(t.get());
+
+	node* c = new node(*t);
+	node_ptr r(c);
+	n--;
+
+	if(n < c->lt->size)
+		c->lt = edit(c->lt, n, f);
+	else if((n -= c->lt->size) < c->eq->size)
+		c->eq = edit(c->eq, n, f);
+	else
+		c->gt = edit(c->gt, n - c->eq->size, f);
+
+	c->size = 1 + c->lt->size + c->eq->size + c->gt->size;
+	return r;
+}
+
+///Set the class of a leaf.
+///@param n The node number.
+///@param is_corner The class.
+void persistent_tree::set_corner(int n, bool is_corner)
+{
+	root = edit(root, n, [&](const node* t)
+	{
+		node* c = new node(*t);
+		c->is_corner = is_corner;
+		return node_ptr(c);
+	});
+}
+
+///Set the offset number of the pixel examined by a node.
+///@param n The node number.
+///@param offset_index The offset number.
+void persistent_tree::set_offset_index(int n, int offset_index)
+{
+	root = edit(root, n, [&](const node* t)
+	{
+		node* c = new node(*t);
+		c->offset_index = offset_index;
+		return node_ptr(c);
+	});
+}
+
+///Replace a subtree with a subtree of another tree (which may be this tree). The 
+///subtree is shared, not copied.
+///@param n The root of the subtree to replace.
+///@param t The tree to take the subtree from.
+///@param m The root of the subtree of \c t.
+void persistent_tree::replace(int n, const persistent_tree& t, int m)
+{
+	//Take a reference to the subtree first, since t may be this tree.
+	node_ptr sub = t.find(m);
+
+	root = edit(root, n, [&](const node*){ return sub; });
+}
+
+///Replace a subtree with a leaf.
+///@param n The root of the subtree to replace.
+///@param is_corner The class of the leaf.
+void persistent_tree::make_leaf(int n, bool is_corner)
+{
+	replace(n, persistent_tree(is_corner));
+}
+
+///Compute a hash of a subtree. This is the same as tree_element::hash().
+///@param t The subtree.
+///@param h Hash of everything preceeding the subtree.
+///@return Hash of the subtree.
+uint64_t persistent_tree::hash(const node* t, uint64_t h)
+{
+	const uint64_t prime = 1099511628211ULL;
+
+	if(t->size == 1)
+		return ((h ^ 2) * prime ^ t->is_corner) * prime;
+	else
+	{
+		h = ((h ^ 3) * prime ^ (uint64_t)t->offset_index) * prime;
+		h = hash(t->lt.get(), h);
+		h = hash(t->eq.get(), h);
+		return hash(t->gt.get(), h);
+	}
+}
+
+///Compute a hash of the structure of the tree. This is the same as tree_element::hash().
+///@return Hash of the tree.
+uint64_t persistent_tree::hash() const
+{
+	return hash(root.get(), 14695981039346656037ULL);
+}
+
+///Append a subtree to a list of flat nodes, in depth-first order.
+///@param t The subtree.
+///@param eq_branch Whether the subtree is the \c eq branch of its parent.
+///@param f The list of nodes.
+void persistent_tree::flatten(const node* t, bool eq_branch, vector<flat_tree::node>& f)
+{
+	flat_tree::node n = {t->offset_index, t->size, t->is_corner, eq_branch};
+	f.push_back(n);
+
+	if(t->size != 1)
+	{
+		flatten(t->lt.get(), false, f);
+		flatten(t->eq.get(), true, f);
+		flatten(t->gt.get(), false, f);
+	}
+}
+
+///Convert the tree to a ::flat_tree, in order to use it. The storage of the ::flat_tree
+///is reused, so converting in to the same ::flat_tree each time does not allocate memory.
+///@param f The converted tree.
+void persistent_tree::flatten(flat_tree& f) const
+{
+	f.clear_view();
+	f.nodes.clear();
+	flatten(root.get(), true, f.nodes);
+}
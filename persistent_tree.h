@@ -0,0 +1,93 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_PERSISTENT_TREE_H
+#define INC_PERSISTENT_TREE_H
+
+#include <memory>
+#include <functional>
+#include <stdint.h>
+
+#include "faster_tree.h"
+#include "flat_tree.h"
+
+///This class holds a tree whose nodes are never modified once made, so that copies
+///of a tree share their nodes. Copying a tree copies only a pointer to the root, and 
+///changing a node copies only the nodes on the path from the root to it (path copying),
+///so a changed copy shares every unchanged subtree with the original. Each node stores 
+///the size of its subtree, so nodes are numbered in the same order as 
+///tree_element::nth_element(), and are found in time proportional to the depth.
+///
+///This makes the proposals in the optimization cheap to make and to throw away. To use
+///the tree, it is converted to a ::flat_tree with flatten().
+///@ingroup gTree
+class persistent_tree
+{
+	public:
+		persistent_tree(const tree_element& t);
+		persistent_tree(bool is_corner=false);
+
+		///This returns the number of nodes in the tree
+		int num_nodes() const
+		{
+			return root->size;
+		}
+
+		bool is_leaf(int n) const;
+		bool is_corner(int n) const;
+		int  offset_index(int n) const;
+		bool eq_branch(int n) const;
+		int lt(int n) const;
+		int eq(int n) const;
+		int gt(int n) const;
+
+		void set_corner(int n, bool is_corner);
+		void set_offset_index(int n, int offset_index);
+		void replace(int n, const persistent_tree& t, int m=0);
+		void make_leaf(int n, bool is_corner);
+
+		uint64_t hash() const;
+		void flatten(flat_tree& f) const;
+
+	private:
+		struct node;
+		typedef std::shared_ptr<const node> node_ptr;
+
+		///A node of the tree. Leaves have no children.
+		struct node
+		{
+			node_ptr lt;       ///< Branch to take if the offset pixel is much darker than the centre.
+			node_ptr eq;       ///< Branch to take otherwise.
+			node_ptr gt;       ///< Branch to take if the offset pixel is much brighter than the centre.
+			int offset_index;  ///< Offset number of the pixel to examine. This indexes offsets[x].
+			int size;          ///< Number of nodes in the subtree starting here. This is 1 for a leaf.
+			bool is_corner;    ///< If the node is a leaf, then this is its attribute.
+		};
+
+		static node_ptr make(const tree_element* t);
+		static node_ptr edit(const node_ptr& t, int n, const std::function<node_ptr(const node*)>& f);
+		static uint64_t hash(const node* t, uint64_t h);
+		static void flatten(const node* t, bool eq_branch, std::vector<flat_tree::node>& f);
+		const node_ptr& find(int n, bool& eq_branch) const;
+		const node_ptr& find(int n) const;
+
+		node_ptr root; ///< The root of the tree.
+};
+
+#endif
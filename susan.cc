@@ -23,6 +23,7 @@
 #include <cvd/image_convert.h>
 
 #include <vector>
+#include <cstdlib>
 #include <gvars3/instances.h>
 
 #include "susan.h"
@@ -40,10 +41,34 @@ using namespace GVars3;
 
 extern "C"
 {
+	void* malloc_haxored(size_t s);
 	void free_haxored_memory();
 	int*  susan(unsigned char* in, int x_size, int y_size, float dt, int bt);
 }
 
+///Memory allocated by the SUSAN code on this thread. The storage is only allocated
+///when a thread first runs SUSAN.
+static thread_local vector<void*> allocs;
+
+///Allocate memory for the SUSAN code. The memory is freed by free_haxored_memory().
+///@param s Number of bytes to allocate.
+///@return The memory.
+void* malloc_haxored(size_t s)
+{
+	void* a = malloc(s);
+	allocs.push_back(a);
+	return a;
+}
+
+///Free all of the memory allocated by malloc_haxored() on this thread.
+void free_haxored_memory()
+{
+	for(unsigned int i=0; i < allocs.size(); i++)
+		free(allocs[i]);
+
+	allocs.clear();
+}
+
 
 void SUSAN::operator()(const CVD::Image<CVD::byte>& im, std::vector<CVD::ImageRef>& corners, unsigned int N) const
 {
@@ -0,0 +1,107 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "thread_pool.h"
+
+///\cond never
+using namespace std;
+///\endcond
+
+///@param threads Number of threads to run tasks on, including the thread which calls run().
+thread_pool::thread_pool(int threads)
+:job(0), num_tasks(0), next(0), busy(0), generation(0), stop(false)
+{
+	for(int i=1; i < threads; i++)
+		workers.push_back(thread(&thread_pool::work, this));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		lock_guard<mutex> l(lock);
+		stop = true;
+	}
+	start.notify_all();
+
+	for(unsigned int i=0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+///Run tasks from the current job until there are none left.
+void thread_pool::run_tasks()
+{
+	for(int i; (i = next++) < num_tasks; )
+		(*job)(i);
+}
+
+///Main loop of the worker threads.
+void thread_pool::work()
+{
+	unsigned long done = 0;
+	unique_lock<mutex> l(lock);
+
+	for(;;)
+	{
+		start.wait(l, [&](){ return stop || generation != done;});
+
+		if(stop)
+			return;
+
+		done = generation;
+
+		l.unlock();
+		run_tasks();
+		l.lock();
+
+		if(--busy == 0)
+			finished.notify_one();
+	}
+}
+
+///Run <code>f(0)</code> to <code>f(tasks-1)</code> in parallel, and wait for them all to finish.
+///The tasks are run in no particular order.
+///@param tasks Number of tasks.
+///@param f The function to run.
+void thread_pool::run(int tasks, const function<void(int)>& f)
+{
+	if(workers.empty() || tasks <= 1)
+	{
+		for(int i=0; i < tasks; i++)
+			f(i);
+		return;
+	}
+
+	lock_guard<mutex> r(run_lock);
+
+	{
+		lock_guard<mutex> l(lock);
+		job = &f;
+		num_tasks = tasks;
+		next = 0;
+		busy = workers.size();
+		generation++;
+	}
+	start.notify_all();
+
+	run_tasks();
+
+	//Every worker must have seen this job before the next one can start.
+	unique_lock<mutex> l(lock);
+	finished.wait(l, [&](){ return busy == 0;});
+}
@@ -0,0 +1,107 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_THREAD_POOL_H
+#define INC_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+///A fixed set of worker threads which run the iterations of a loop in parallel.
+///The thread calling run() also does some of the work, so a pool of one thread
+///has no workers, and runs everything in the calling thread.
+///
+///Calls to run() from several threads are serialised. The function being run must
+///not call run() on the same pool.
+///@ingroup gUtility
+class thread_pool
+{
+	public:
+		thread_pool(int threads);
+		~thread_pool();
+
+		void run(int tasks, const std::function<void(int)>& f);
+
+		///Number of threads which run tasks, including the calling thread.
+		int size() const
+		{
+			return workers.size() + 1;
+		}
+
+	private:
+		void work();
+		void run_tasks();
+
+		std::vector<std::thread> workers;         ///< The worker threads
+		std::mutex run_lock;                      ///< Serialises calls to run()
+		std::mutex lock;                          ///< Protects the data below
+		std::condition_variable start;            ///< Signalled when a job is ready, or the pool is stopping
+		std::condition_variable finished;         ///< Signalled when the last worker finishes a job
+		const std::function<void(int)>* job;      ///< The current job
+		int num_tasks;                            ///< Number of tasks in the current job
+		std::atomic<int> next;                    ///< Next task of the current job to run
+		int busy;                                 ///< Number of workers yet to finish the current job
+		unsigned long generation;                 ///< Incremented for every job
+		bool stop;                                ///< Whether the workers should exit
+};
+
+///Run a loop over a range in parallel, where each part of the range produces a list
+///of results. The range is split in to contiguous chunks, which are processed in parallel,
+///and the results are appended to \c out in the order of the chunks. If \c f produces its results
+///in order, then the output is identical to <code>f(begin, end, out)</code>, which is
+///what happens if the pool has only one thread.
+///@param pool The threads to use.
+///@param begin Start of the range.
+///@param end End of the range.
+///@param grain Smallest chunk worth running in a separate task.
+///@param out Results are appended to this.
+///@param f Function called as <code>f(chunk_begin, chunk_end, results)</code>.
+///@ingroup gUtility
+template<class T, class F> void ordered_for(thread_pool& pool, int begin, int end, int grain, std::vector<T>& out, const F& f)
+{
+	long n = end - begin;
+
+	if(n <= 0)
+		return;
+
+	//Use several chunks per thread, so that uneven chunks are balanced out.
+	int chunks = std::min<long>(pool.size() * 4, (n + grain - 1) / grain);
+
+	if(pool.size() == 1 || chunks <= 1)
+	{
+		f(begin, end, out);
+		return;
+	}
+
+	std::vector<std::vector<T> > parts(chunks);
+	pool.run(chunks, [&](int i)
+	{
+		f(begin + n * i / chunks, begin + n * (i + 1) / chunks, parts[i]);
+	});
+
+	for(unsigned int i=0; i < parts.size(); i++)
+		out.insert(out.end(), parts[i].begin(), parts[i].end());
+}
+
+#endif
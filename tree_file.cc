@@ -0,0 +1,265 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "tree_file.h"
+#include "offsets.h"
+
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gvars3/instances.h>
+
+///\cond never
+using namespace std;
+using namespace GVars3;
+///\endcond
+
+namespace
+{
+	const char magic[8] = {'\x89', 'F', 'A', 'S', 'T', 'E', 'R', '\n'};
+	const uint32_t version = 1;
+	const size_t header_size = 40;
+	const size_t node_size = 12;
+
+	///Compute the FNV-1a hash of some bytes.
+	///@param d The bytes.
+	///@param n Number of bytes.
+	///@return The hash.
+	uint64_t checksum(const char* d, size_t n)
+	{
+		uint64_t h = 14695981039346656037ULL;
+
+		for(size_t i=0; i < n; i++)
+			h = (h ^ (unsigned char)d[i]) * 1099511628211ULL;
+
+		return h;
+	}
+
+	///Read a value which may not be aligned.
+	///@param d Position of the value.
+	///@return The value.
+	template<class T> T get(const char* d)
+	{
+		T t;
+		memcpy(&t, d, sizeof(T));
+		return t;
+	}
+
+	///Append the bytes of a value to a buffer.
+	///@param b The buffer.
+	///@param t The value.
+	template<class T> void put(vector<char>& b, const T& t)
+	{
+		const char* d = reinterpret_cast<const char*>(&t);
+		b.insert(b.end(), d, d + sizeof(T));
+	}
+
+	///Unmaps a file when it goes out of scope.
+	struct mapping
+	{
+		void* data;  ///< Start of the mapping.
+		size_t size; ///< Size of the mapping.
+
+		~mapping()
+		{
+			if(data != MAP_FAILED)
+				munmap(data, size);
+		}
+	};
+}
+
+///Does a stream hold a binary tree? This looks at the next character without
+///removing it from the stream.
+///@param i The stream.
+///@return Whether the stream starts with the first character of the binary tree format.
+///@ingroup gTreeFile
+bool is_binary_tree(istream& i)
+{
+	return i.peek() == (unsigned char)magic[0];
+}
+
+///Load a tree from the binary format, held in memory. See \ref gTreeFile for the format.
+///@param data Start of the file.
+///@param size Size of the file in bytes.
+///@return The tree.
+///@ingroup gTreeFile
+flat_tree parse_binary_tree(const char* data, size_t size)
+{
+	if(size < header_size || memcmp(data, magic, sizeof(magic)) != 0 || get<uint32_t>(data + 8) != version)
+		throw ParseError();
+
+	uint64_t num_file_offsets = get<uint32_t>(data + 12);
+	uint64_t num_nodes = get<uint32_t>(data + 16);
+	size_t nodes_pos = header_size + num_file_offsets * 8;
+	size_t checksum_pos = nodes_pos + num_nodes * node_size;
+
+	if(num_nodes == 0 || checksum_pos + 8 != size || get<uint64_t>(data + checksum_pos) != checksum(data, checksum_pos))
+		throw ParseError();
+
+	//The offset numbers must mean the same as they did when the tree was saved.
+	if(offsets.empty() || num_file_offsets != offsets[0].size())
+		throw ParseError();
+
+	for(unsigned int i=0; i < num_file_offsets; i++)
+		if(get<int32_t>(data + header_size + i*8) != offsets[0][i].x || get<int32_t>(data + header_size + i*8 + 4) != offsets[0][i].y)
+			throw ParseError();
+
+	vector<flat_tree::node> nodes(num_nodes);
+	for(unsigned int i=0; i < num_nodes; i++)
+	{
+		const char* d = data + nodes_pos + i * node_size;
+
+		if((unsigned char)d[8] > 1 || (unsigned char)d[9] > 1)
+			throw ParseError();
+
+		nodes[i].offset_index = get<int32_t>(d);
+		nodes[i].size = get<int32_t>(d + 4);
+		nodes[i].is_corner = d[8];
+		nodes[i].eq_branch = d[9];
+	}
+
+	//Check that the subtree sizes describe a tree, and that the invariants hold.
+	if(nodes[0].size != (int)num_nodes || !nodes[0].eq_branch)
+		throw ParseError();
+
+	for(int n=0; n < (int)num_nodes; n++)
+	{
+		const flat_tree::node& t = nodes[n];
+
+		if(t.size < 1 || t.size > (int)num_nodes - n)
+			throw ParseError();
+
+		if(t.size == 1)
+		{
+			if(t.eq_branch && t.is_corner)
+				throw ParseError();
+		}
+		else
+		{
+			if(t.offset_index < 0 || t.offset_index >= num_offsets)
+				throw ParseError();
+
+			//Children, as in flat_tree::lt(), eq() and gt(), checking that each one
+			//starts inside this subtree.
+			int lt = n + 1;
+			int eq = lt + nodes[lt].size;
+			if(eq >= n + t.size)
+				throw ParseError();
+
+			int gt = eq + nodes[eq].size;
+			if(gt >= n + t.size || gt + nodes[gt].size != n + t.size)
+				throw ParseError();
+
+			if(nodes[lt].eq_branch || !nodes[eq].eq_branch || nodes[gt].eq_branch)
+				throw ParseError();
+		}
+	}
+
+	return flat_tree(nodes);
+}
+
+///Load a tree from a file in the binary format. The file is memory mapped, and the
+///nodes are copied straight from the mapping in to the tree, so the file is not read
+///in to a buffer first. See \ref gTreeFile for the format.
+///If the file can not be read, then ParseError is thrown, and \c errno is set.
+///@param filename The file.
+///@return The tree.
+///@ingroup gTreeFile
+flat_tree load_binary_tree(const string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd == -1)
+		throw ParseError();
+
+	struct stat s;
+	if(fstat(fd, &s) == -1)
+	{
+		close(fd);
+		throw ParseError();
+	}
+
+	mapping m;
+	m.size = s.st_size;
+	m.data = m.size ? mmap(0, m.size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+
+	if(m.data == MAP_FAILED)
+		throw ParseError();
+
+	return parse_binary_tree(static_cast<const char*>(m.data), m.size);
+}
+
+///Load a tree from a file in either format. Binary files are loaded with
+///load_binary_tree(), and text files are parsed with load_a_flat_tree(). Detectors
+///can be run on the tree with flat_tree::tree(), which does not copy the tree.
+///If the file can not be read, then ParseError is thrown, and \c errno is set.
+///@param filename The file.
+///@return The tree.
+///@ingroup gTreeFile
+flat_tree load_tree_file(const string& filename)
+{
+	ifstream i(filename.c_str(), ios::binary);
+	if(!i.good())
+		throw ParseError();
+
+	if(is_binary_tree(i))
+		return load_binary_tree(filename);
+	else
+		return load_a_flat_tree(i);
+}
+
+///Save a tree in the binary format. See \ref gTreeFile for the format. The radii 
+///are taken from the \c offsets.min_radius and \c offsets.max_radius variables.
+///@param o The stream to save to. This should be opened in binary mode.
+///@param t The tree.
+///@ingroup gTreeFile
+void save_binary_tree(ostream& o, const flat_tree& t)
+{
+	vector<char> b(magic, magic + sizeof(magic));
+	put<uint32_t>(b, version);
+	put<uint32_t>(b, offsets[0].size());
+	put<uint32_t>(b, t.num_nodes());
+	put<uint32_t>(b, 0);
+	put<double>(b, GV3::get<double>("offsets.min_radius"));
+	put<double>(b, GV3::get<double>("offsets.max_radius"));
+
+	for(unsigned int i=0; i < offsets[0].size(); i++)
+	{
+		put<int32_t>(b, offsets[0][i].x);
+		put<int32_t>(b, offsets[0][i].y);
+	}
+
+	for(int i=0; i < t.num_nodes(); i++)
+	{
+		put<int32_t>(b, t[i].offset_index);
+		put<int32_t>(b, t[i].size);
+		put<uint8_t>(b, t[i].is_corner);
+		put<uint8_t>(b, t[i].eq_branch);
+		put<uint16_t>(b, 0);
+	}
+
+	put<uint64_t>(b, checksum(&b[0], b.size()));
+	o.write(&b[0], b.size());
+}
@@ -0,0 +1,65 @@
+/*
+
+    This file is part of the FAST-ER machine learning system.
+    Copyright (C) 2008  Edward Rosten and Los Alamos National Laboratory
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef INC_TREE_FILE_H
+#define INC_TREE_FILE_H
+
+#include <string>
+#include <iostream>
+#include <cstddef>
+
+#include "flat_tree.h"
+
+///@defgroup gTreeFile Binary tree files
+///
+///Trees can be stored in a binary format as well as the text format made by
+///tree_element::print(). The binary format holds the nodes as an array, in the
+///order used by ::flat_tree, so loading a tree needs no parsing. The file also
+///holds the radii and the list of offsets that the tree was learned with. A tree
+///is only loaded if these match the current ::offsets, since offset numbers mean
+///nothing without the offsets. A checksum at the end of the file detects damaged files.
+///
+///The file has the following layout. All values are stored in native byte order,
+///which is little endian on x86. A file with the wrong byte order does not load.
+///- 8 bytes: the magic number <code>\\x89FASTER\\n</code>
+///- 32 bit unsigned: format version (currently 1)
+///- 32 bit unsigned: number of offsets, \e O
+///- 32 bit unsigned: number of nodes, \e N
+///- 32 bit unsigned: zero
+///- double: \c offsets.min_radius
+///- double: \c offsets.max_radius
+///- \e O pairs of 32 bit signed: x and y of each offset, in the first orientation
+///- \e N nodes, of 12 bytes each, in depth first order (see ::flat_tree):
+///  - 32 bit signed: offset number
+///  - 32 bit signed: number of nodes in the subtree
+///  - 8 bit: 1 if the node is a corner, 0 otherwise
+///  - 8 bit: 1 if the node is an \c eq branch, 0 otherwise
+///  - 16 bit: zero
+///- 64 bit unsigned: FNV-1a hash of all of the preceeding bytes
+///
+///The functions throw ParseError if a file is not a valid tree.
+///@ingroup gTree
+
+bool is_binary_tree(std::istream& i);
+flat_tree parse_binary_tree(const char* data, size_t size);
+flat_tree load_binary_tree(const std::string& filename);
+flat_tree load_tree_file(const std::string& filename);
+void save_binary_tree(std::ostream& o, const flat_tree& t);
+
+#endif